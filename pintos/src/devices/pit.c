@@ -11,8 +11,12 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
+/* System control port B, which holds channel 2's gate input,
+   its connection to the speaker, and the state of its output. */
+#define PIT_PORT_GATE   0x61
+#define PIT_GATE_2      0x01            /* Channel 2 counts when set. */
+#define PIT_SPEAKER_2   0x02            /* Channel 2 drives the speaker. */
+#define PIT_OUTPUT_2    0x20            /* Channel 2's output. */
 
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
@@ -81,3 +85,69 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts CHANNEL counting down COUNT PIT cycles once, in mode 0
+   ("interrupt on terminal count").  The channel's output goes
+   high, raising interrupt line 0 for channel 0, when the count
+   reaches zero, and stays high until the channel is programmed
+   again.  COUNT must be between 1 and 65536.  Unlike the
+   periodic modes, the count starts as soon as it is loaded, so
+   the delay is measured from the call. */
+void
+pit_start_oneshot (int channel, unsigned count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+  ASSERT (count >= 1 && count <= PIT_COUNT_MAX);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb (PIT_PORT_COUNTER (channel), count);
+  outb (PIT_PORT_COUNTER (channel), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the number of PIT cycles left before CHANNEL's
+   counter next reaches zero, as a value between 1 and 65536. */
+unsigned
+pit_read_count (int channel)
+{
+  enum intr_level old_level;
+  unsigned count;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  /* Latch the counter so that its two bytes are read from the
+     same instant. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, channel << 6);
+  count = inb (PIT_PORT_COUNTER (channel));
+  count |= inb (PIT_PORT_COUNTER (channel)) << 8;
+  intr_set_level (old_level);
+
+  return count != 0 ? count : PIT_COUNT_MAX;
+}
+
+/* Starts channel 2 counting down COUNT cycles, between 1 and
+   65536, with the speaker disconnected.  Channel 2 is not wired
+   to an interrupt, but pit_channel2_expired() can poll for the
+   end of the count, which makes it a stopwatch that works with
+   interrupts off. */
+void
+pit_channel2_start (unsigned count)
+{
+  enum intr_level old_level = intr_disable ();
+  outb (PIT_PORT_GATE,
+        (inb (PIT_PORT_GATE) & ~PIT_SPEAKER_2) | PIT_GATE_2);
+  pit_start_oneshot (2, count);
+  intr_set_level (old_level);
+}
+
+/* Returns true if the count started by pit_channel2_start() has
+   run out. */
+bool
+pit_channel2_expired (void)
+{
+  return (inb (PIT_PORT_GATE) & PIT_OUTPUT_2) != 0;
+}
@@ -1,8 +1,19 @@
 #ifndef DEVICES_PIT_H
 #define DEVICES_PIT_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+/* PIT cycles per second. */
+#define PIT_HZ 1193180
+
+/* Largest count a PIT channel can be loaded with. */
+#define PIT_COUNT_MAX 65536
+
 void pit_configure_channel (int channel, int mode, int frequency);
+void pit_start_oneshot (int channel, unsigned count);
+unsigned pit_read_count (int channel);
+void pit_channel2_start (unsigned count);
+bool pit_channel2_expired (void);
 
 #endif /* devices/pit.h */
@@ -4,7 +4,9 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/heapstat.h"
 #include "threads/io.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
@@ -13,6 +15,9 @@
 #include "devices/block.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/swap.h"
+#endif
 
 /* Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -132,6 +137,10 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  kmem_print_stats ();
+#ifdef HEAP_STATS
+  heapstat_print ();
+#endif
 #ifdef FILESYS
   block_print_stats ();
 #endif
@@ -140,4 +149,7 @@ print_stats (void)
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  swap_print_stats ();
+#endif
 }
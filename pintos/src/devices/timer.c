@@ -9,6 +9,8 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
@@ -27,22 +29,84 @@
 static int64_t ticks;
 
 /* Number of loops per timer tick.
-   Initialized by timer_calibrate(). */
+   Initialized by timer_calibrate() or timer_preset_calibration(). */
 static unsigned loops_per_tick;
 
-/* List of threads in THREAD_BLOCKED state because it called timer_sleep.
-   Ordered based on threads' wake up time.*/
-static struct list sleep_list;
+/* Threads in THREAD_BLOCKED state because they called
+   timer_sleep, in a heap ordered by wake up time, so that the
+   interrupt handler finds the next thread to wake in O(1) and
+   sleeping or waking a thread costs O(log n). */
+static struct heap sleep_heap;
+
+/* Time-stamp counter (TSC) cycles per timer tick, or 0 until
+   the timer is calibrated.  The TSC counts processor
+   cycles, so it tells the time far more finely than `ticks'. */
+static uint64_t tsc_per_tick;
+
+/* Threads sleeping for less than a tick, in a heap ordered by
+   the TSC value at which they are due. */
+static struct heap hrtimer_heap;
+
+/* Sleeps shorter than this many microseconds busy-wait, because
+   blocking and being woken by an interrupt takes about as long. */
+#define HRTIMER_MIN_US 20
+
+/* One-shot mode.
+
+   Normally the PIT interrupts once per tick.  It is switched to
+   one-shot mode, interrupting once at a programmed time, in two
+   cases:
+
+     - While a thread sleeps for less than a tick, so that it is
+       woken at its deadline rather than at the next tick.
+
+     - While the idle thread runs, unless `timer_tickless' is
+       false.  There is nothing for the timer to do until the
+       next sleeping thread is due, so the ticks in between take
+       no interrupt.
+
+   In one-shot mode the times of the ticks are kept in TSC
+   cycles, so each interrupt counts the ticks that have really
+   passed, whenever it arrives.  The PIT's 16-bit counter limits
+   a one-shot to about 55 ms, so long idle periods still take
+   one interrupt per 55 ms.  When neither case applies any more,
+   the timer goes back to periodic mode at the next tick. */
+bool timer_tickless = true;
+
+/* PIT cycles per timer tick. */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+static bool oneshot;            /* In one-shot mode? */
+static bool idling;             /* Idle thread running tickless? */
+static uint64_t next_tick_tsc;  /* In one-shot mode, TSC value at which
+                                   tick number ticks + 1 is due. */
+static int64_t skipped_ticks;   /* Ticks that took no interrupt. */
 
 static intr_handler_func timer_interrupt;
-static bool too_many_loops (unsigned loops);
+static uint64_t measure_tsc (void);
+static unsigned measure_loops (void);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
-
-static bool compare_ticks(const struct list_elem *a,
-  const struct list_elem *b,
-  void *aux);
+static bool wake_sleepers (void);
+static void hrtimer_sleep (uint64_t tsc);
+static bool wake_hrtimers (uint64_t now);
+static void start_oneshot (void);
+static void program_oneshot (void);
+static int64_t count_ticks (uint64_t now, bool all);
+static void skip_ticks (int64_t cnt);
+
+static heap_less_func compare_ticks;
+static heap_less_func compare_tsc;
+
+/* Returns the processor's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
@@ -51,34 +115,52 @@ timer_init (void)
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
-  list_init (&sleep_list);
+  heap_init (&sleep_heap, compare_ticks, NULL);
+  heap_init (&hrtimer_heap, compare_tsc, NULL);
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Length of the PIT count that the TSC is measured against: 5
+   ms, short enough to run with interrupts off without losing a
+   tick. */
+#define CALIBRATE_CYCLES (PIT_HZ / 200)
+
+/* Calibrates loops_per_tick, used to implement brief delays,
+   and tsc_per_tick, used to implement brief sleeps.  Values
+   given with timer_preset_calibration() are used as they are.
+   Otherwise, the TSC is timed against a single count of PIT
+   channel 2 and the delay loop against the TSC, which together
+   take a few milliseconds. */
 void
 timer_calibrate (void)
 {
-  unsigned high_bit, test_bit;
-
   ASSERT (intr_get_level () == INTR_ON);
   printf ("Calibrating timer...  ");
 
-  /* Approximate loops_per_tick as the largest power-of-two
-     still less than one timer tick. */
-  loops_per_tick = 1u << 10;
-  while (!too_many_loops (loops_per_tick << 1))
-  {
-    loops_per_tick <<= 1;
-    ASSERT (loops_per_tick != 0);
-  }
+  if (tsc_per_tick == 0)
+    tsc_per_tick = measure_tsc ();
+  if (loops_per_tick == 0)
+    loops_per_tick = measure_loops ();
 
-  /* Refine the next 8 bits of loops_per_tick. */
-  high_bit = loops_per_tick;
-  for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
-    if (!too_many_loops (high_bit | test_bit))
-      loops_per_tick |= test_bit;
+  printf ("%'"PRIu64" loops/s, %'"PRIu64" TSC cycles/s (-calib=%u:%"PRIu64").\n",
+          (uint64_t) loops_per_tick * TIMER_FREQ, tsc_per_tick * TIMER_FREQ,
+          loops_per_tick, tsc_per_tick);
+}
 
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+/* Sets the calibration from VALUE, which has the form
+   LOOPS:TSC as printed by timer_calibrate(), so that a machine
+   booted many times need not calibrate each time.  Must be
+   called before timer_calibrate(). */
+void
+timer_preset_calibration (char *value)
+{
+  char *save_ptr;
+  char *loops = value != NULL ? strtok_r (value, ":", &save_ptr) : NULL;
+  char *tsc = loops != NULL ? strtok_r (NULL, "", &save_ptr) : NULL;
+
+  if (loops == NULL || tsc == NULL || atoi (loops) <= 0 || atoi (tsc) <= 0)
+    PANIC ("-calib requires LOOPS:TSC, as printed at boot");
+  loops_per_tick = atoi (loops);
+  tsc_per_tick = atoi (tsc);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -119,10 +201,10 @@ timer_sleep (int64_t ticks)
   t = thread_current();
   t->tick_to_wake = timer_ticks () + ticks;    /* Records when to wake up. */
 
-  /* Inserts thread into sleeping list ordered based on tick_to_wake. */
-  list_insert_ordered(&sleep_list, &t->sleep_elem, compare_ticks, NULL);
+  /* Inserts thread into sleeping heap keyed on tick_to_wake. */
+  heap_insert (&sleep_heap, &t->sleep_elem);
 
-  sema_down(&t->sleep_mutex);
+  thread_block ();
   intr_set_level (old_level);
 }
 
@@ -134,20 +216,68 @@ timer_sleep (int64_t ticks)
 *
 * Returns true if the wake up time for a is less than that of b.
 */
-bool compare_ticks(const struct list_elem *a,
-                   const struct list_elem *b,
-                   void *aux) {
+static bool compare_ticks(const struct heap_elem *a,
+                   const struct heap_elem *b,
+                   void *aux UNUSED) {
   struct thread *t1 = NULL;
   struct thread *t2 = NULL;
 
   /* Gets the threads that contains element a and b. */
-  t1 = list_entry (a, struct thread, sleep_elem);
-  t2 = list_entry (b, struct thread, sleep_elem);
+  t1 = heap_entry (a, struct thread, sleep_elem);
+  t2 = heap_entry (b, struct thread, sleep_elem);
 
   /* Returns the comparison between wake up times. */
   return t1->tick_to_wake < t2->tick_to_wake;
 }
 
+/* Returns true if thread A is due to wake from a sub-tick sleep
+   before thread B. */
+static bool
+compare_tsc (const struct heap_elem *a, const struct heap_elem *b,
+             void *aux UNUSED)
+{
+  return (heap_entry (a, struct thread, sleep_elem)->tsc_to_wake
+          < heap_entry (b, struct thread, sleep_elem)->tsc_to_wake);
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  Stops the timer from interrupting until the
+   next sleeping thread is due. */
+void
+timer_idle_enter (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || tsc_per_tick == 0)
+    return;
+
+  idling = true;
+  if (!oneshot)
+    start_oneshot ();
+  else
+    program_oneshot ();
+}
+
+/* Called with interrupts off when a thread other than the idle
+   thread is about to run.  Counts the ticks that passed without
+   an interrupt while idle and makes the timer interrupt on the
+   next tick again. */
+void
+timer_idle_exit (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!idling)
+    return;
+
+  /* Leave the last tick that has passed, if any, to the timer
+     interrupt, which is then due at once: it may have a thread
+     to wake or the load average to update. */
+  skip_ticks (count_ticks (rdtsc (), false));
+  idling = false;
+  program_oneshot ();
+}
+
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
    turned on. */
 void
@@ -212,62 +342,281 @@ timer_ndelay (int64_t ns)
 void
 timer_print_stats (void)
 {
-  printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  printf ("Timer: %"PRId64" ticks, %"PRId64" skipped while idle\n",
+          timer_ticks (), skipped_ticks);
 }
 
 
 /* Timer interrupt handler.
-   Every time there is a timer interrupt, check whether there
-   are threads to be waken up: ticks == t -> tick_to_wake.
-
-   Continue to check the first element in the list since
-   the threads are ordered by their time to wake up.
-
-   Stop is the list is empty or ticks < t -> tick_to_wake. */
-// Yige, Pengdi, and Peijie Driving
+   In periodic mode, every interrupt is one tick.  In one-shot
+   mode, counts the ticks that have passed since the last
+   interrupt, if any, wakes the threads whose sub-tick sleeps are
+   over, and programs the next interrupt. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  ticks++;
-  thread_tick ();
+  int64_t passed = 1;           /* Ticks that have passed. */
+  bool woken = false;           /* Whether any thread was woken. */
 
-  enum intr_level old_level;        /* Old interrupt level. */
-  struct thread *t;                 /* Thread needs to be waken up first. */
-  struct list_elem *front;          /* First element of the list. */
+  if (oneshot)
+    {
+      uint64_t now = rdtsc ();
 
-  old_level = intr_disable ();
+      passed = count_ticks (now, true);
+      if (passed > 1)
+        skip_ticks (passed - 1);
+      woken = wake_hrtimers (now);
+    }
+
+  if (passed > 0)
+    {
+      ticks++;
+      thread_tick ();
+      if (wake_sleepers ())
+        woken = true;
+    }
+
+  if (oneshot)
+    {
+      if (idling || !heap_empty (&hrtimer_heap) || passed == 0)
+        program_oneshot ();
+      else
+        {
+          /* On a tick, with nothing to wait for before the next
+             one. */
+          oneshot = false;
+          pit_configure_channel (0, 2, TIMER_FREQ);
+        }
+    }
+
+  /* Always check pre-emption after thread_unblock. */
+  if (woken) {
+    check_preemption ();
+  }
+}
+
+/* Wakes the threads whose timer_sleep() is over, and returns
+   true if there were any.
+   Continue to take the minimum of the heap since the threads
+   are ordered by their time to wake up.
+
+   Stop when the heap is empty or ticks < t -> tick_to_wake.
+   All threads due on the same tick are woken as one batch. */
+// Yige, Pengdi, and Peijie Driving
+static bool
+wake_sleepers (void)
+{
+  struct thread *t;                 /* Thread needs to be waken up first. */
+  bool woken = false;               /* Whether any thread was woken. */
 
-  while(!list_empty(&sleep_list)) {
-    front = list_begin(&sleep_list);
-    t = list_entry (front, struct thread, sleep_elem);
-    if (timer_ticks() < t->tick_to_wake) {
-      /* No more threads in list needs to be waken up, exits while loop. */
+  while(!heap_empty(&sleep_heap)) {
+    t = heap_entry (heap_min (&sleep_heap), struct thread, sleep_elem);
+    if (ticks < t->tick_to_wake) {
+      /* No more threads in heap needs to be waken up, exits while loop. */
       break;
     }
-    /* Wake up the thread containing first element. */
-    list_pop_front(&sleep_list);
-    sema_up(&t->sleep_mutex);
+    /* Wake up the thread with the earliest wake up time. */
+    heap_pop_min(&sleep_heap);
+    thread_unblock (t);
+    woken = true;
   }
+  return woken;
+}
+
+/* Sleeps for TSC cycles, which should be less than a tick.  The
+   timer switches to one-shot mode to interrupt at the deadline,
+   so the thread does not wait for the next tick. */
+static void
+hrtimer_sleep (uint64_t tsc)
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  old_level = intr_disable ();
+  t->tsc_to_wake = rdtsc () + tsc;
+  heap_insert (&hrtimer_heap, &t->sleep_elem);
+  if (!oneshot)
+    start_oneshot ();
+  else
+    program_oneshot ();
+  thread_block ();
   intr_set_level (old_level);
 }
 
-/* Returns true if LOOPS iterations waits for more than one timer
-   tick, otherwise false. */
+/* Wakes the threads whose hrtimer_sleep() is over by TSC value
+   NOW, and returns true if there were any. */
 static bool
-too_many_loops (unsigned loops)
+wake_hrtimers (uint64_t now)
 {
-  /* Wait for a timer tick. */
-  int64_t start = ticks;
-  while (ticks == start)
-  barrier ();
+  bool woken = false;
+
+  while (!heap_empty (&hrtimer_heap))
+    {
+      struct thread *t = heap_entry (heap_min (&hrtimer_heap),
+                                     struct thread, sleep_elem);
+      if (now < t->tsc_to_wake)
+        break;
+      heap_pop_min (&hrtimer_heap);
+      thread_unblock (t);
+      woken = true;
+    }
+  return woken;
+}
 
-  /* Run LOOPS loops. */
-  start = ticks;
-  busy_wait (loops);
+/* Switches the timer from periodic to one-shot mode.  Works out
+   when the next tick is due from how far the PIT has counted
+   through the current one. */
+static void
+start_oneshot (void)
+{
+  bool pending;
+  unsigned phase;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!oneshot);
+
+  /* If the interrupt for a tick is still pending, the PIT is
+     already counting down to the tick after.  Read the count
+     again if the PIT reaches a tick in between. */
+  do
+    {
+      pending = intr_ext_pending (0x20);
+      phase = pit_read_count (0);
+    }
+  while (intr_ext_pending (0x20) != pending);
 
-  /* If the tick count changed, we iterated too long. */
-  barrier ();
-  return start != ticks;
+  next_tick_tsc = rdtsc () + phase * tsc_per_tick / TICK_CYCLES;
+  if (pending)
+    next_tick_tsc -= tsc_per_tick;
+  oneshot = true;
+  program_oneshot ();
+}
+
+/* Programs the PIT to interrupt at the next tick, or while
+   idling at the tick on which the next sleeping thread is due,
+   or at the end of a sub-tick sleep if that is sooner. */
+static void
+program_oneshot (void)
+{
+  uint64_t deadline = next_tick_tsc;
+  uint64_t now;
+  unsigned count;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (oneshot);
+
+  if (idling)
+    {
+      /* Skip ahead at most a second, and under the MLFQS not
+         past the next load average update. */
+      int64_t wake = ticks + TIMER_FREQ;
+
+      if (!heap_empty (&sleep_heap))
+        {
+          struct thread *t = heap_entry (heap_min (&sleep_heap),
+                                         struct thread, sleep_elem);
+          if (t->tick_to_wake < wake)
+            wake = t->tick_to_wake;
+        }
+      if (thread_mlfqs && wake > (ticks / TIMER_FREQ + 1) * TIMER_FREQ)
+        wake = (ticks / TIMER_FREQ + 1) * TIMER_FREQ;
+      if (wake > ticks + 1)
+        deadline += (wake - ticks - 1) * tsc_per_tick;
+    }
+  if (!heap_empty (&hrtimer_heap))
+    {
+      struct thread *t = heap_entry (heap_min (&hrtimer_heap),
+                                     struct thread, sleep_elem);
+      if (t->tsc_to_wake < deadline)
+        deadline = t->tsc_to_wake;
+    }
+
+  /* Round up, so that the interrupt does not arrive before the
+     deadline. */
+  now = rdtsc ();
+  if (deadline <= now)
+    count = 1;
+  else if (deadline - now >= PIT_COUNT_MAX * tsc_per_tick / TICK_CYCLES)
+    count = PIT_COUNT_MAX;
+  else
+    count = DIV_ROUND_UP ((deadline - now) * TICK_CYCLES, tsc_per_tick);
+  pit_start_oneshot (0, count);
+}
+
+/* Returns the number of ticks that are due by TSC value NOW in
+   one-shot mode, except for the last one unless ALL is true, and
+   advances next_tick_tsc past them. */
+static int64_t
+count_ticks (uint64_t now, bool all)
+{
+  uint64_t end = all ? now : now - tsc_per_tick;
+  int64_t cnt = 0;
+
+  ASSERT (oneshot);
+
+  while (next_tick_tsc <= end)
+    {
+      next_tick_tsc += tsc_per_tick;
+      cnt++;
+    }
+  return cnt;
+}
+
+/* Counts CNT ticks that passed without a timer interrupt. */
+static void
+skip_ticks (int64_t cnt)
+{
+  ticks += cnt;
+  skipped_ticks += cnt;
+  thread_skip_ticks (cnt, idling);
+}
+
+/* Returns the number of TSC cycles per timer tick, timed against
+   one count of PIT channel 2. */
+static uint64_t
+measure_tsc (void)
+{
+  enum intr_level old_level;
+  uint64_t start, end;
+
+  old_level = intr_disable ();
+  pit_channel2_start (CALIBRATE_CYCLES);
+  start = rdtsc ();
+  while (!pit_channel2_expired ())
+    continue;
+  end = rdtsc ();
+  intr_set_level (old_level);
+
+  return (end - start) * TICK_CYCLES / CALIBRATE_CYCLES;
+}
+
+/* Returns the number of busy_wait() loops per timer tick, timed
+   with the TSC. */
+static unsigned
+measure_loops (void)
+{
+  enum intr_level old_level;
+  int64_t loops = 1 << 12;
+  uint64_t elapsed;
+
+  /* Double the loop count until a run takes long enough, 1/16
+     tick, that reading the TSC around it hardly matters.  The
+     short runs before it warm up the cache. */
+  old_level = intr_disable ();
+  for (;;)
+    {
+      uint64_t start = rdtsc ();
+      busy_wait (loops);
+      elapsed = rdtsc () - start;
+      if (elapsed >= tsc_per_tick / 16)
+        break;
+      loops *= 2;
+    }
+  intr_set_level (old_level);
+
+  return loops * tsc_per_tick / elapsed;
 }
 
 /* Iterates through a simple loop LOOPS times, for implementing
@@ -303,10 +652,17 @@ real_time_sleep (int64_t num, int32_t denom)
        processes. */
     timer_sleep (ticks);
   }
+  else if (tsc_per_tick != 0
+           && num * 1000 * 1000 >= (int64_t) HRTIMER_MIN_US * denom)
+  {
+    /* Otherwise, block until a timer interrupt programmed for
+       the exact deadline. */
+    hrtimer_sleep (num * tsc_per_tick * TIMER_FREQ / denom);
+  }
   else
   {
-    /* Otherwise, use a busy-wait loop for more accurate
-       sub-tick timing. */
+    /* Too short to be worth blocking.  Use a busy-wait loop for
+       more accurate sub-tick timing. */
     real_time_delay (num, denom);
   }
 }
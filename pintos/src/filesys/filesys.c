@@ -12,6 +12,9 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "threads/thread.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -28,6 +31,8 @@ filesys_init (bool format)
     PANIC ("No file system device found, can't initialize file system.");
 
   inode_init ();
+  file_init ();
+  dir_init ();
   free_map_init ();
 
   if (format)
@@ -41,6 +46,9 @@ filesys_init (bool format)
 void
 filesys_done (void)
 {
+#ifdef VM
+  frame_cache_flush ();
+#endif
   free_map_close ();
 }
 
@@ -12,7 +12,12 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -54,6 +59,9 @@ struct inode
   int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
   struct inode_disk data;             /* Inode content. */
   struct lock inode_lock;             /* Synchronize changes to files. */
+#ifdef VM
+  struct list frames;                 /* Its frames in the page cache. */
+#endif
 };
 
 /* Returns the block device sector that contains byte offset POS
@@ -98,11 +106,32 @@ byte_to_sector (const struct inode *inode, off_t pos)
   returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Cache of struct inode. */
+static struct kmem_cache inode_cache;
+static kmem_ctor_func inode_ctor;
+
+#ifdef VM
+static off_t cache_read_at (struct inode *, uint8_t *, off_t, off_t);
+static off_t cache_write_at (struct inode *, const uint8_t *, off_t, off_t);
+static void cache_clear_tail (struct inode *);
+#endif
+static void clear_past_end (const struct inode *, off_t, uint8_t *);
+
 /* Initializes the inode module. */
 void
 inode_init (void)
 {
   list_init (&open_inodes);
+  kmem_cache_init (&inode_cache, "inode", sizeof (struct inode), inode_ctor);
+}
+
+/* Constructs an inode in inode_cache.  Its lock is free again
+   by the time the inode is closed for the last time. */
+static void
+inode_ctor (void *inode_)
+{
+  struct inode *inode = inode_;
+  lock_init (&inode->inode_lock);
 }
 
 /* Add block sectors into indirect block. If indirect_block is
@@ -333,7 +362,7 @@ inode_open (block_sector_t sector)
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (&inode_cache);
   if (inode == NULL)
     return NULL;
 
@@ -343,7 +372,9 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  lock_init(&inode->inode_lock);
+#ifdef VM
+  list_init (&inode->frames);
+#endif
   block_read (fs_device, inode->sector, &inode->data);
   return inode;
 }
@@ -381,6 +412,12 @@ inode_close (struct inode *inode)
   /* Release resources if this was the last opener. */
   if (--inode->open_cnt == 0)
   {
+#ifdef VM
+    /* Write back the file's cached pages, or discard them if the
+       file is going away. */
+    frame_cache_drop (inode, !inode->removed);
+#endif
+
     /* Remove from inode list and release lock. */
     list_remove (&inode->elem);
 
@@ -431,7 +468,7 @@ inode_close (struct inode *inode)
         free_map_release(inode->data.double_indirect_block, 1);
       }
     }
-    free (inode);
+    kmem_cache_free (&inode_cache, inode);
   }
 }
 
@@ -461,6 +498,9 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   off_t bytes_read = 0;
   uint8_t *bounce = NULL;
 
+#ifdef VM
+  bytes_read = cache_read_at (inode, buffer, size, offset);
+#else
   while (size > 0)
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -501,6 +541,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
+#endif
   free (bounce);
 
   return bytes_read;
@@ -551,6 +592,9 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
   /* Updates file length */
   if (new_length > inode_disk->length) {
+#ifdef VM
+    cache_clear_tail (inode);
+#endif
     inode_disk->length = new_length;
     block_write (fs_device, inode->sector, inode_disk);
     block_read (fs_device, inode->sector, &inode->data);
@@ -561,6 +605,9 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
     lock_release(&inode->inode_lock);
   }
 
+#ifdef VM
+  bytes_written = cache_write_at (inode, buffer, size, offset);
+#else
   while (size > 0)
   {
     /* Sector to write, starting byte offset within sector. */
@@ -608,6 +655,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
     offset += chunk_size;
     bytes_written += chunk_size;
   }
+#endif
 
   /* Updates file read length */
   if (new_length > inode_disk->eof) {
@@ -622,6 +670,171 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   return bytes_written;
 }
 
+/* Reads the page of INODE's data at page-aligned OFFSET from
+   disk into the PGSIZE bytes at PAGE.  Bytes past the end of the
+   file read as zeros.  Used by the page cache. */
+void
+inode_read_page (struct inode *inode, off_t offset, void *page)
+{
+  uint8_t *p = page;
+  off_t ofs;
+
+  ASSERT (offset % PGSIZE == 0);
+
+  for (ofs = 0; ofs < PGSIZE && offset + ofs < inode->data.length;
+       ofs += BLOCK_SECTOR_SIZE)
+    block_read (fs_device, byte_to_sector (inode, offset + ofs), p + ofs);
+  clear_past_end (inode, offset, p);
+}
+
+/* Writes the PGSIZE bytes at PAGE to INODE's data at
+   page-aligned OFFSET on disk.  Bytes past the end of the file,
+   which a memory mapping of the file's last page may have
+   written, are cleared first so that they never reach the disk.
+   Used by the page cache. */
+void
+inode_write_page (struct inode *inode, off_t offset, void *page)
+{
+  uint8_t *p = page;
+  off_t ofs;
+
+  ASSERT (offset % PGSIZE == 0);
+
+  clear_past_end (inode, offset, p);
+  for (ofs = 0; ofs < PGSIZE && offset + ofs < inode->data.length;
+       ofs += BLOCK_SECTOR_SIZE)
+    block_write (fs_device, byte_to_sector (inode, offset + ofs), p + ofs);
+}
+
+/* Zeroes the bytes of PAGE, which holds the page of INODE's data
+   at page-aligned OFFSET, that lie past the end of the file. */
+static void
+clear_past_end (const struct inode *inode, off_t offset, uint8_t *page)
+{
+  off_t end = inode->data.length - offset;
+
+  if (end < 0)
+    end = 0;
+  if (end < PGSIZE)
+    memset (page + end, 0, PGSIZE - end);
+}
+
+#ifdef VM
+/* Returns the list of INODE's frames in the page cache, which
+   the frame table maintains. */
+struct list *
+inode_frames (struct inode *inode)
+{
+  return &inode->frames;
+}
+#endif
+
+#ifdef VM
+/* Clears the bytes past the end of INODE's data in the page
+   cache page that holds the end of the file, before the file
+   grows over them, in case a memory mapping wrote there.  A page
+   that is not cached was cleared when it was written back. */
+static void
+cache_clear_tail (struct inode *inode)
+{
+  off_t length = inode->data.length;
+  struct frame *f;
+
+  if (length % PGSIZE == 0)
+    return;
+  f = frame_cache_try_get (inode, ROUND_DOWN (length, PGSIZE));
+  if (f != NULL)
+    {
+      clear_past_end (inode, ROUND_DOWN (length, PGSIZE), f->kpage);
+      frame_unpin (f);
+    }
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at OFFSET,
+   through the page cache.  Returns the number of bytes read. */
+static off_t
+cache_read_at (struct inode *inode, uint8_t *buffer, off_t size,
+               off_t offset)
+{
+  off_t bytes_read = 0;
+
+  while (size > 0)
+    {
+      /* Starting byte offset within page. */
+      int page_ofs = offset % PGSIZE;
+
+      /* Bytes left in inode, bytes left in page, lesser of the two. */
+      off_t inode_left = inode->data.eof - offset;
+      int page_left = PGSIZE - page_ofs;
+      int min_left = inode_left < page_left ? inode_left : page_left;
+
+      /* Number of bytes to actually copy out of this page. */
+      int chunk_size = size < min_left ? size : min_left;
+      struct frame *f;
+
+      if (chunk_size <= 0)
+        break;
+      f = frame_cache_get (inode, offset - page_ofs, true);
+      if (f == NULL)
+        break;
+      memcpy (buffer + bytes_read, (uint8_t *) f->kpage + page_ofs,
+              chunk_size);
+      frame_unpin (f);
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   through the page cache, which writes them to disk later.  The
+   file must already be long enough.  Returns the number of
+   bytes written. */
+static off_t
+cache_write_at (struct inode *inode, const uint8_t *buffer, off_t size,
+                off_t offset)
+{
+  off_t bytes_written = 0;
+
+  while (size > 0)
+    {
+      /* Starting byte offset within page. */
+      int page_ofs = offset % PGSIZE;
+
+      /* Bytes left in inode, bytes left in page, lesser of the two. */
+      off_t inode_left = inode_length (inode) - offset;
+      int page_left = PGSIZE - page_ofs;
+      int min_left = inode_left < page_left ? inode_left : page_left;
+
+      /* Number of bytes to actually write into this page. */
+      int chunk_size = size < min_left ? size : min_left;
+      struct frame *f;
+
+      if (chunk_size <= 0)
+        break;
+
+      /* A page about to be overwritten entirely need not be read
+         first. */
+      f = frame_cache_get (inode, offset - page_ofs, chunk_size < PGSIZE);
+      if (f == NULL)
+        break;
+      memcpy ((uint8_t *) f->kpage + page_ofs, buffer + bytes_written,
+              chunk_size);
+      frame_set_dirty (f);
+      frame_unpin (f);
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_written += chunk_size;
+    }
+  return bytes_written;
+}
+#endif
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -6,6 +6,7 @@
 #include "devices/block.h"
 
 struct bitmap;
+struct list;
 
 void inode_init (void);
 bool inode_create (block_sector_t, off_t, bool);
@@ -17,6 +18,8 @@ bool inode_is_removed (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+void inode_read_page (struct inode *, off_t offset, void *page);
+void inode_write_page (struct inode *, off_t offset, void *page);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
@@ -24,5 +27,8 @@ bool inode_isdir(struct inode *);
 bool inode_is_open(struct inode *);
 void inode_lock_acquire(struct inode *);
 void inode_lock_release(struct inode *);
+#ifdef VM
+struct list *inode_frames (struct inode *);
+#endif
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,183 @@
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *meld (struct heap *, struct heap_elem *,
+                               struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+static void detach (struct heap_elem *);
+
+/* Initializes heap H to order its elements with LESS given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux)
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->elem_cnt = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into heap H. */
+void
+heap_insert (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  h->root = meld (h, h->root, e);
+  h->elem_cnt++;
+}
+
+/* Removes the minimum element from heap H and returns it.
+   H must not be empty. */
+struct heap_elem *
+heap_pop_min (struct heap *h)
+{
+  struct heap_elem *min;
+
+  ASSERT (!heap_empty (h));
+
+  min = h->root;
+  h->root = merge_pairs (h, min->child);
+  h->elem_cnt--;
+  return min;
+}
+
+/* Removes element E, which must be in heap H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (!heap_empty (h));
+  ASSERT (e != NULL);
+
+  if (e == h->root)
+    heap_pop_min (h);
+  else
+    {
+      detach (e);
+      h->root = meld (h, h->root, merge_pairs (h, e->child));
+      h->elem_cnt--;
+    }
+}
+
+/* Restores the heap order after the key of element E, which must
+   be in heap H, has changed in either direction. */
+void
+heap_update (struct heap *h, struct heap_elem *e)
+{
+  heap_remove (h, e);
+  heap_insert (h, e);
+}
+
+/* Returns the minimum element in heap H, or a null pointer if H
+   is empty. */
+struct heap_elem *
+heap_min (const struct heap *h)
+{
+  ASSERT (h != NULL);
+
+  return h->root;
+}
+
+/* Returns the number of elements in heap H. */
+size_t
+heap_size (const struct heap *h)
+{
+  ASSERT (h != NULL);
+
+  return h->elem_cnt;
+}
+
+/* Returns true if heap H contains no elements, false
+   otherwise. */
+bool
+heap_empty (const struct heap *h)
+{
+  ASSERT (h != NULL);
+
+  return h->root == NULL;
+}
+
+/* Combines the heap-ordered trees rooted at A and B, either of
+   which may be null, into one and returns its root.  The root
+   comes back with no siblings. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b)
+{
+  struct heap_elem *t;
+
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+
+  /* Make A the root, so that B becomes its first child. */
+  if (h->less (b, a, h->aux))
+    {
+      t = a;
+      a = b;
+      b = t;
+    }
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+  a->next = a->prev = NULL;
+  return a;
+}
+
+/* Melds the sibling list starting at FIRST into a single tree
+   and returns its root, or a null pointer if FIRST is null.
+   Uses the standard two passes, melding pairs from left to right
+   and then the results from right to left, without recursion so
+   that long sibling lists don't overflow the kernel stack. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first)
+{
+  struct heap_elem *pairs = NULL;       /* Melded pairs, last first. */
+  struct heap_elem *root = NULL;
+
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+
+      first = b != NULL ? b->next : NULL;
+      a->next = a->prev = NULL;
+      if (b != NULL)
+        {
+          b->next = b->prev = NULL;
+          a = meld (h, a, b);
+        }
+      a->next = pairs;
+      pairs = a;
+    }
+
+  while (pairs != NULL)
+    {
+      struct heap_elem *next = pairs->next;
+      pairs->next = NULL;
+      root = meld (h, root, pairs);
+      pairs = next;
+    }
+  return root;
+}
+
+/* Unlinks non-root element E, along with its subtree, from its
+   parent and siblings. */
+static void
+detach (struct heap_elem *e)
+{
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+  e->next = e->prev = NULL;
+}
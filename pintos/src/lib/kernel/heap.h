@@ -0,0 +1,72 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+
+   This is a pairing heap: a tree in which every node is no
+   greater than its children, each node keeping its children in a
+   linked list.  Insertion and finding the minimum take O(1)
+   time; removing the minimum, removing an arbitrary element, and
+   changing an element's key take O(log n) amortized time.
+
+   Like lists and hash tables, heaps do not use dynamic
+   allocation.  Each structure that can be in a heap embeds a
+   struct heap_elem member, and heap_entry converts a struct
+   heap_elem back to the structure that contains it.  Refer to
+   lib/kernel/list.h for a detailed explanation of the technique.
+
+   A heap orders its elements with the HEAP_LESS_FUNC it was
+   initialized with, so a less function that compares in reverse
+   makes a max-heap. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *child;    /* First child. */
+    struct heap_elem *next;     /* Next sibling. */
+    struct heap_elem *prev;     /* Previous sibling, or parent of the
+                                   first child. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) (HEAP_ELEM)            \
+                     - offsetof (STRUCT, MEMBER)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Minimum element, or null. */
+    size_t elem_cnt;            /* Number of elements. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+/* Insertion and deletion. */
+void heap_insert (struct heap *, struct heap_elem *);
+struct heap_elem *heap_pop_min (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_update (struct heap *, struct heap_elem *);
+
+/* Information. */
+struct heap_elem *heap_min (const struct heap *);
+size_t heap_size (const struct heap *);
+bool heap_empty (const struct heap *);
+
+#endif /* lib/kernel/heap.h */
@@ -23,15 +23,15 @@ extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
-//extern test_func test_mlfqs_load_1;
-//extern test_func test_mlfqs_load_60;
-//extern test_func test_mlfqs_load_avg;
-//extern test_func test_mlfqs_recent_1;
-//extern test_func test_mlfqs_fair_2;
-//extern test_func test_mlfqs_fair_20;
-//extern test_func test_mlfqs_nice_2;
-//extern test_func test_mlfqs_nice_10;
-//extern test_func test_mlfqs_block;
+extern test_func test_mlfqs_load_1;
+extern test_func test_mlfqs_load_60;
+extern test_func test_mlfqs_load_avg;
+extern test_func test_mlfqs_recent_1;
+extern test_func test_mlfqs_fair_2;
+extern test_func test_mlfqs_fair_20;
+extern test_func test_mlfqs_nice_2;
+extern test_func test_mlfqs_nice_10;
+extern test_func test_mlfqs_block;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
@@ -0,0 +1,78 @@
+/* Forks a child and has parent and child each overwrite their
+   data, BSS, and stack after the fork, in whichever order they
+   happen to run.  Each must see only its own writes.  Covers
+   BSS pages that were written, only read, and never touched
+   before the fork. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 3
+
+static char data[PAGE_CNT * 4096] = {'o'};
+static char bss[PAGE_CNT * 4096];
+
+/* Returns true if every byte of the SIZE bytes at BUF is C. */
+static bool
+all_bytes (const char *buf, size_t size, char c) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (buf[i] != c)
+      return false;
+  return true;
+}
+
+/* Overwrites every page with C. */
+static void
+fill (char *stack, char c) 
+{
+  memset (data, c, sizeof data);
+  memset (bss, c, sizeof bss);
+  memset (stack, c, 4096);
+}
+
+/* Returns true if every page holds only C. */
+static bool
+check (const char *stack, char c) 
+{
+  return (all_bytes (data, sizeof data, c)
+          && all_bytes (bss, sizeof bss, c)
+          && all_bytes (stack, 4096, c));
+}
+
+void
+test_main (void) 
+{
+  char stack[4096];
+  volatile char sink;
+  pid_t pid;
+
+  /* Leave BSS page 0 written, page 1 only read, page 2 untouched. */
+  memset (data, 'o', sizeof data);
+  memset (bss, 'o', 4096);
+  sink = bss[4096];
+  memset (stack, 'o', sizeof stack);
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      /* The parent may already have written its copy. */
+      if (!all_bytes (data, sizeof data, 'o')
+          || !all_bytes (bss, 4096, 'o')
+          || !all_bytes (bss + 4096, sizeof bss - 4096, 0)
+          || !all_bytes (stack, sizeof stack, 'o'))
+        exit (1);
+      fill (stack, 'c');
+      exit (check (stack, 'c') ? 0 : 2);
+    }
+
+  CHECK (pid > 0, "fork");
+  fill (stack, 'p');
+  CHECK (wait (pid) == 0, "wait for child");
+  CHECK (check (stack, 'p'), "parent's pages are unchanged");
+  (void) sink;
+}
@@ -0,0 +1,37 @@
+/* Opens a file and reads part of it, then forks.  The child
+   must inherit the descriptor at the same position and read on
+   from there, without moving the parent's position. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SKIP 20
+
+void
+test_main (void) 
+{
+  char buf[SKIP];
+  int handle;
+  pid_t pid;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (read (handle, buf, SKIP) == SKIP, "read first %d bytes", SKIP);
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      if (tell (handle) != SKIP)
+        exit (1);
+      if (read (handle, buf, SKIP) != SKIP
+          || memcmp (buf, sample + SKIP, SKIP))
+        exit (2);
+      exit (0);
+    }
+
+  CHECK (pid > 0, "fork");
+  CHECK (wait (pid) == 0, "wait for child");
+  CHECK (tell (handle) == SKIP, "parent's position is unchanged");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-fd) begin
+(fork-fd) open "sample.txt"
+(fork-fd) read first 20 bytes
+(fork-fd) fork
+(fork-fd) wait for child
+(fork-fd) parent's position is unchanged
+(fork-fd) end
+EOF
+pass;
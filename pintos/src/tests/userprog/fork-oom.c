@@ -0,0 +1,80 @@
+/* Forks recursively until fork() fails or MAX_DEPTH processes
+   are running, each writing every page of a buffer so that
+   copy-on-write gives it a private copy.  Every process checks
+   that it inherited its parent's contents and that its own copy
+   survives its child.  A failed fork() must return -1, not kill
+   the parent.
+
+   The root repeats this several times and checks that the same
+   depth is reached every time, so that fork() under memory
+   pressure leaks nothing. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define MAX_DEPTH 40
+#define MIN_DEPTH 8
+#define REPETITIONS 3
+
+static char buf[16 * 4096];
+
+/* Returns true if every byte of BUF is C. */
+static bool
+all_bytes (char c) 
+{
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != c)
+      return false;
+  return true;
+}
+
+/* Runs the process at DEPTH and returns the greatest depth
+   reached below it, or -1 on error. */
+static int
+recurse (int depth) 
+{
+  int reached;
+  pid_t pid;
+
+  memset (buf, depth, sizeof buf);
+  if (depth == MAX_DEPTH)
+    return depth;
+
+  pid = fork ();
+  if (pid == 0)
+    exit (all_bytes (depth) ? recurse (depth + 1) : -1);
+  if (pid == -1)
+    return depth;
+
+  reached = wait (pid);
+  if (reached == -1 || !all_bytes (depth))
+    return -1;
+  return reached;
+}
+
+void
+test_main (void) 
+{
+  int expected_depth = 0;
+  int i;
+
+  for (i = 0; i < REPETITIONS; i++)
+    {
+      int reached = recurse (1);
+
+      if (reached == -1)
+        fail ("a process lost its memory");
+      if (i == 0)
+        expected_depth = reached;
+      else if (reached != expected_depth)
+        fail ("after run %d/%d, expected depth %d, actual depth %d",
+              i, REPETITIONS, expected_depth, reached);
+    }
+  if (expected_depth < MIN_DEPTH)
+    fail ("should have forked at least %d times", MIN_DEPTH);
+  msg ("success. forked to the same depth %d times.", REPETITIONS);
+}
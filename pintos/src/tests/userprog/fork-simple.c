@@ -0,0 +1,28 @@
+/* Forks a child, which must get 0 from fork() and see the
+   parent's data and stack as they were at the time of the fork.
+   The parent gets the child's pid, and the child's exit status
+   reports what it saw. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int data = 42;
+
+void
+test_main (void) 
+{
+  char stack[64];
+  pid_t pid;
+
+  strlcpy (stack, "copied stack", sizeof stack);
+  data = 43;
+
+  pid = fork ();
+  if (pid == 0)
+    exit (data == 43 && !strcmp (stack, "copied stack") ? 81 : 1);
+
+  CHECK (pid > 0, "fork");
+  CHECK (wait (pid) == 81, "wait for child");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-simple) begin
+(fork-simple) fork
+(fork-simple) wait for child
+(fork-simple) end
+EOF
+pass;
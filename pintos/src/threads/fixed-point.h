@@ -0,0 +1,56 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point numbers, used by the multi-level
+   feedback queue scheduler for recent_cpu and load_avg.  The
+   kernel has no floating point, so a real number X is stored as
+   the integer X * FIX_F. */
+typedef int fixed_t;
+
+#define FIX_F (1 << 14)                 /* 1.0 in fixed point. */
+
+/* Converts integer N to fixed point. */
+static inline fixed_t
+fix_int (int n)
+{
+  return n * FIX_F;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int
+fix_trunc (fixed_t x)
+{
+  return x / FIX_F;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fix_round (fixed_t x)
+{
+  return x >= 0 ? (x + FIX_F / 2) / FIX_F : (x - FIX_F / 2) / FIX_F;
+}
+
+/* Returns X + N. */
+static inline fixed_t
+fix_add_int (fixed_t x, int n)
+{
+  return x + n * FIX_F;
+}
+
+/* Returns X * Y. */
+static inline fixed_t
+fix_mul (fixed_t x, fixed_t y)
+{
+  return (int64_t) x * y / FIX_F;
+}
+
+/* Returns X / Y. */
+static inline fixed_t
+fix_div (fixed_t x, fixed_t y)
+{
+  return (int64_t) x * FIX_F / y;
+}
+
+#endif /* threads/fixed-point.h */
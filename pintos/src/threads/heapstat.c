@@ -0,0 +1,184 @@
+#include "threads/heapstat.h"
+#ifdef HEAP_STATS
+#include <debug.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+
+/* Heap usage by call site.
+
+   In a kernel built with HEAP_STATS, malloc() and palloc()
+   charge each allocation to the address it was called from, and
+   remember the charged site alongside the allocation so that
+   freeing it credits the same site, wherever it is freed from.
+   At shutdown, the sites holding the most memory are printed
+   together with a `backtrace' command line that translates
+   their addresses into function names.  Memory still live at
+   shutdown is a leak, unless the kernel keeps it on purpose. */
+
+/* Number of call sites tracked.  Further sites are lumped
+   together in overflow_site. */
+#define SITE_CNT 512
+
+/* Number of sites printed by heapstat_print(). */
+#define REPORT_CNT 16
+
+/* Allocations charged to one call site. */
+struct heap_site
+  {
+    const void *caller;         /* Return address of allocation call. */
+    bool pages;                 /* From palloc() rather than malloc()? */
+    size_t live_bytes;          /* Bytes allocated and not yet freed. */
+    size_t peak_bytes;          /* Maximum of live_bytes. */
+    int64_t alloc_cnt;          /* Number of allocations. */
+    int64_t free_cnt;           /* Number of frees. */
+  };
+
+/* Table of sites, open addressed by caller.  Sites are never
+   removed. */
+static struct heap_site sites[SITE_CNT];
+static size_t site_cnt;
+static struct heap_site overflow_site;
+
+static struct heap_site *find_site (const void *caller, bool pages);
+
+/* Charges an allocation of BYTES to the call site at CALLER,
+   from the page allocator if PAGES is true or from malloc()
+   otherwise, and returns the site to pass to heapstat_free()
+   when the allocation is freed.  May be called with interrupts
+   off. */
+struct heap_site *
+heapstat_alloc (const void *caller, bool pages, size_t bytes)
+{
+  struct heap_site *s;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  s = find_site (caller, pages);
+  s->alloc_cnt++;
+  s->live_bytes += bytes;
+  if (s->live_bytes > s->peak_bytes)
+    s->peak_bytes = s->live_bytes;
+  intr_set_level (old_level);
+  return s;
+}
+
+/* Credits BYTES freed to site S, as returned by
+   heapstat_alloc().  A null S is ignored.  May be called with
+   interrupts off. */
+void
+heapstat_free (struct heap_site *s, size_t bytes)
+{
+  enum intr_level old_level;
+
+  if (s == NULL)
+    return;
+
+  old_level = intr_disable ();
+  ASSERT (s->live_bytes >= bytes);
+  s->free_cnt++;
+  s->live_bytes -= bytes;
+  intr_set_level (old_level);
+}
+
+/* Prints the REPORT_CNT sites with the most live memory, and
+   then the largest peak, followed by a command that symbolizes
+   their addresses. */
+void
+heapstat_print (void)
+{
+  bool printed[SITE_CNT];
+  struct heap_site *report[REPORT_CNT];
+  size_t report_cnt;
+  int64_t seconds;
+  size_t i, j;
+
+  /* Pick the top sites by selection, which is fine for a table
+     this small. */
+  for (i = 0; i < SITE_CNT; i++)
+    printed[i] = false;
+  for (report_cnt = 0; report_cnt < REPORT_CNT; report_cnt++)
+    {
+      struct heap_site *best = NULL;
+      size_t best_idx = 0;
+
+      for (i = 0; i < SITE_CNT; i++)
+        {
+          struct heap_site *s = &sites[i];
+          if (s->caller == NULL || printed[i])
+            continue;
+          if (best == NULL
+              || s->live_bytes > best->live_bytes
+              || (s->live_bytes == best->live_bytes
+                  && s->peak_bytes > best->peak_bytes))
+            {
+              best = s;
+              best_idx = i;
+            }
+        }
+      if (best == NULL)
+        break;
+      printed[best_idx] = true;
+      report[report_cnt] = best;
+    }
+
+  seconds = timer_ticks () / TIMER_FREQ;
+  if (seconds == 0)
+    seconds = 1;
+
+  printf ("Heap: %zu call sites, top %zu by live bytes:\n",
+          site_cnt, report_cnt);
+  printf ("  %-10s %-6s %10s %10s %10s %10s %8s\n",
+          "site", "from", "live", "peak", "allocs", "frees", "allocs/s");
+  for (j = 0; j < report_cnt; j++)
+    {
+      struct heap_site *s = report[j];
+      printf ("  %-10p %-6s %10zu %10zu %10"PRId64" %10"PRId64" %8"PRId64"\n",
+              s->caller, s->pages ? "palloc" : "malloc",
+              s->live_bytes, s->peak_bytes, s->alloc_cnt, s->free_cnt,
+              s->alloc_cnt / seconds);
+    }
+  if (overflow_site.alloc_cnt > 0)
+    printf ("  %-10s %-6s %10zu %10zu %10"PRId64" %10"PRId64"\n",
+            "(other)", "", overflow_site.live_bytes, overflow_site.peak_bytes,
+            overflow_site.alloc_cnt, overflow_site.free_cnt);
+
+  if (report_cnt > 0)
+    {
+      printf ("To translate call sites, run: backtrace kernel.o");
+      for (j = 0; j < report_cnt; j++)
+        printf (" %p", report[j]->caller);
+      printf ("\n");
+    }
+}
+
+/* Returns the site for CALLER and PAGES, adding it to the table
+   if it is new.  Interrupts must be off. */
+static struct heap_site *
+find_site (const void *caller, bool pages)
+{
+  size_t i = ((uintptr_t) caller >> 2) % SITE_CNT;
+  size_t probes;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (probes = 0; probes < SITE_CNT; probes++)
+    {
+      struct heap_site *s = &sites[i];
+      if (s->caller == caller && s->pages == pages)
+        return s;
+      if (s->caller == NULL)
+        {
+          s->caller = caller;
+          s->pages = pages;
+          site_cnt++;
+          return s;
+        }
+      i = (i + 1) % SITE_CNT;
+    }
+  return &overflow_site;
+}
+
+#endif /* HEAP_STATS */
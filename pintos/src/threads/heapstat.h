@@ -0,0 +1,20 @@
+#ifndef THREADS_HEAPSTAT_H
+#define THREADS_HEAPSTAT_H
+
+/* Kernel heap usage by call site.  Only compiled in when the
+   kernel is built with `make HEAP_STATS=1'. */
+#ifdef HEAP_STATS
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct heap_site;
+
+struct heap_site *heapstat_alloc (const void *caller, bool pages,
+                                  size_t bytes);
+void heapstat_free (struct heap_site *, size_t bytes);
+void heapstat_print (void);
+
+#endif /* HEAP_STATS */
+
+#endif /* threads/heapstat.h */
@@ -37,6 +37,12 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#include "vm/wset.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -59,6 +65,7 @@ static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
 static void paging_init (void);
+static uint32_t cpu_features (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -98,6 +105,10 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+#ifdef VM
+  frame_init ();
+  page_init ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -119,6 +130,9 @@ main (void)
   thread_start ();
   serial_init_queue ();
   timer_calibrate ();
+#ifdef USERPROG
+  process_init ();
+#endif
 
 #ifdef FILESYS
   /* Initialize file system. */
@@ -127,6 +141,11 @@ main (void)
   filesys_init (format_filesys);
 #endif
 
+#ifdef VM
+  swap_init ();
+  wset_init ();
+#endif
+
   printf ("Boot complete.\n");
 
   /* Run actions specified on kernel command line. */
@@ -150,16 +169,47 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* CPUID function 1 feature flags in EDX.  See [IA32-v2a]
+   "CPUID--CPU Identification". */
+#define CPUID_PSE 0x00000008    /* 4 MB pages. */
+#define CPUID_PGE 0x00002000    /* Global pages. */
+
+/* CR4 flags.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR4_PSE 0x00000010      /* Page size extension. */
+#define CR4_PGE 0x00000080      /* Page global enable. */
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports 4 MB pages, each 4 MB region of RAM that
+   holds no kernel code is mapped by a single PDE instead of a
+   page table.  That saves a page table per region and lets the
+   TLB cover far more of the kernel's view of memory.  Regions
+   with kernel code keep 4 kB pages so the code stays
+   read-only.
+
+   If the CPU supports global pages, the kernel mappings are
+   marked global.  They are the same in every page directory, so
+   they can stay in the TLB when a context switch reloads CR3. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  uint32_t features = cpu_features ();
+  bool pse = (features & CPUID_PSE) != 0;
+  bool pge = (features & CPUID_PGE) != 0;
+  uint32_t global = pge ? PTE_G : 0;
+
+  if (pse)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+    }
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -171,13 +221,27 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (pse && pte_idx == 0)
+        {
+          size_t large_pages = PTSPAN / PGSIZE;
+          char *large_end = vaddr + PTSPAN;
+
+          if (page + large_pages <= init_ram_pages
+              && (large_end <= &_start || vaddr >= &_end_kernel_text))
+            {
+              pd[pde_idx] = pde_create_large (vaddr, true) | global;
+              page += large_pages - 1;
+              continue;
+            }
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
     }
 
   /* Store the physical address of the page directory into CR3
@@ -186,6 +250,26 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  /* Enable global pages only once the new mappings are in place,
+     so that no stale loader mapping becomes global. */
+  if (pge)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PGE));
+    }
+}
+
+/* Returns the feature flags that CPUID function 1 reports in
+   EDX. */
+static uint32_t
+cpu_features (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return edx;
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -256,6 +340,10 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-periodic"))
+        timer_tickless = false;
+      else if (!strcmp (name, "-calib"))
+        timer_preset_calibration (value);
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -379,6 +467,8 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -periodic          Keep the timer ticking while idle.\n"
+          "  -calib=LOOPS:TSC   Use timer calibration printed by an earlier boot.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
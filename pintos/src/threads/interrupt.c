@@ -214,6 +214,20 @@ intr_context (void)
   return in_external_intr;
 }
 
+/* Returns true if external interrupt VEC_NO has been raised but
+   not yet delivered, e.g. because interrupts are off.  Reads the
+   PIC's interrupt request register. */
+bool
+intr_ext_pending (uint8_t vec_no)
+{
+  int port = vec_no < 0x28 ? PIC0_CTRL : PIC1_CTRL;
+
+  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+
+  outb (port, 0x0a);            /* OCW3: next read returns IRR. */
+  return (inb (port) & (1 << (vec_no & 7))) != 0;
+}
+
 /* During processing of an external interrupt, directs the
    interrupt handler to yield to a new process just before
    returning from the interrupt.  May not be called at any other
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/heapstat.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -60,12 +61,24 @@ struct block
     struct list_elem free_elem; /* Free list element. */
   };
 
+#ifdef HEAP_STATS
+/* In a HEAP_STATS kernel, each block starts with a tag naming
+   the call site it is charged to. */
+struct heap_tag
+  {
+    struct heap_site *site;     /* Charged call site. */
+    size_t size;                /* Requested size in bytes. */
+  };
+#endif
+
 /* Our set of descriptors. */
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void *malloc_from (size_t, const void *caller);
+static void *block_alloc (size_t);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -88,6 +101,35 @@ malloc_init (void)
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) 
+{
+  return malloc_from (size, __builtin_return_address (0));
+}
+
+/* Does the work of malloc(), charging the block to CALLER in a
+   HEAP_STATS kernel. */
+static void *
+malloc_from (size_t size, const void *caller UNUSED)
+{
+#ifdef HEAP_STATS
+  struct heap_tag *tag;
+
+  if (size == 0)
+    return NULL;
+  tag = block_alloc (sizeof *tag + size);
+  if (tag == NULL)
+    return NULL;
+  tag->site = heapstat_alloc (caller, false, size);
+  tag->size = size;
+  return tag + 1;
+#else
+  return block_alloc (size);
+#endif
+}
+
+/* Obtains and returns a new block of at least SIZE bytes from
+   the descriptors or, for a big block, the page allocator. */
+static void *
+block_alloc (size_t size)
 {
   struct desc *d;
   struct block *b;
@@ -167,7 +209,7 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = malloc_from (size, __builtin_return_address (0));
   if (p != NULL)
     memset (p, 0, size);
 
@@ -178,11 +220,15 @@ calloc (size_t a, size_t b)
 static size_t
 block_size (void *block) 
 {
+#ifdef HEAP_STATS
+  return ((struct heap_tag *) block - 1)->size;
+#else
   struct block *b = block;
   struct arena *a = block_to_arena (b);
   struct desc *d = a->desc;
 
   return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
+#endif
 }
 
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
@@ -201,7 +247,8 @@ realloc (void *old_block, size_t new_size)
     }
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block = malloc_from (new_size,
+                                     __builtin_return_address (0));
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
@@ -218,6 +265,15 @@ realloc (void *old_block, size_t new_size)
 void
 free (void *p) 
 {
+#ifdef HEAP_STATS
+  if (p != NULL)
+    {
+      struct heap_tag *tag = (struct heap_tag *) p - 1;
+      heapstat_free (tag->site, tag->size);
+      p = tag;
+    }
+#endif
+
   if (p != NULL)
     {
       struct block *b = p;
@@ -2,13 +2,15 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/heapstat.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,13 +25,54 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a binary buddy system.  A free block
+   of 2**K pages, aligned to 2**K pages within the pool, sits on
+   the free list for order K.  An allocation splits the smallest
+   large enough block, and a free merges a block with its buddy
+   for as long as the buddy is free too, so both take O(log n)
+   time and freed memory coalesces back into large blocks.
+   Requests for a page count that is not a power of two give
+   back the unused tail of their block right away.
+
+   The idle thread zeroes a few free pages of each pool ahead of
+   time, so that most PAL_ZERO requests don't have to.
+
+   Pages are freed by the scheduler when a thread dies and zeroed
+   by the idle thread, neither of which may block, so the pools
+   are protected by disabling interrupts rather than by a lock.
+   Every operation is short enough for that. */
+
+/* Most free pages kept zeroed in advance, per pool. */
+#define ZEROED_MAX 64
+
+/* Largest block order: blocks of up to 2**MAX_ORDER pages. */
+#define MAX_ORDER 20
+
+/* Per-page bookkeeping.  Free blocks are linked through the
+   entry for their first page, not through the free memory
+   itself, so that free pages can be zeroed in advance. */
+struct block
+  {
+    struct list_elem elem;      /* In a free list or zeroed list. */
+    int order;                  /* Order if first page of a free block,
+                                   otherwise -1. */
+#ifdef HEAP_STATS
+    struct heap_site *site;     /* Call site charged, if first page of
+                                   an allocation. */
+#endif
+  };
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    struct bitmap *used_map;            /* Bitmap of pages in use. */
+    struct block *blocks;               /* One per page. */
+    struct list free_lists[MAX_ORDER + 1]; /* Free blocks by order. */
+    struct list zeroed;                 /* Pages zeroed in advance. */
+    size_t zeroed_cnt;                  /* Number of pages in zeroed. */
+    size_t page_cnt;                    /* Number of pages in pool. */
     uint8_t *base;                      /* Base of pool. */
   };
 
@@ -39,6 +82,14 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static bool prezero_page (struct pool *);
+static void *get_multiple (enum palloc_flags, size_t page_cnt,
+                           const void *caller);
+static size_t alloc_range (struct pool *, size_t page_cnt);
+static size_t alloc_block (struct pool *, int order);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
+static void free_block (struct pool *, size_t page_idx, int order);
+static void release_zeroed (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -69,17 +120,61 @@ palloc_init (size_t user_page_limit)
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+{
+  return get_multiple (flags, page_cnt, __builtin_return_address (0));
+}
+
+/* Obtains a single free page and returns its kernel virtual
+   address.
+   If PAL_USER is set, the page is obtained from the user pool,
+   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   then the page is filled with zeros.  If no pages are
+   available, returns a null pointer, unless PAL_ASSERT is set in
+   FLAGS, in which case the kernel panics. */
+void *
+palloc_get_page (enum palloc_flags flags) 
+{
+  return get_multiple (flags, 1, __builtin_return_address (0));
+}
+
+/* Does the work of palloc_get_multiple(), charging the pages to
+   CALLER in a HEAP_STATS kernel. */
+static void *
+get_multiple (enum palloc_flags flags, size_t page_cnt,
+              const void *caller UNUSED)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
   void *pages;
   size_t page_idx;
+  bool zeroed = false;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  old_level = intr_disable ();
+  if ((flags & PAL_ZERO) && page_cnt == 1 && !list_empty (&pool->zeroed))
+    {
+      /* Take a page the idle thread has already zeroed. */
+      struct list_elem *e = list_pop_front (&pool->zeroed);
+      page_idx = list_entry (e, struct block, elem) - pool->blocks;
+      pool->zeroed_cnt--;
+      zeroed = true;
+    }
+  else
+    {
+      page_idx = alloc_range (pool, page_cnt);
+      if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0)
+        {
+          /* The zeroed reserve is only worth keeping while there
+             is memory to spare. */
+          release_zeroed (pool);
+          page_idx = alloc_range (pool, page_cnt);
+        }
+      if (page_idx != BITMAP_ERROR)
+        bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+    }
+  intr_set_level (old_level);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -88,8 +183,12 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 
   if (pages != NULL) 
     {
-      if (flags & PAL_ZERO)
+      if ((flags & PAL_ZERO) && !zeroed)
         memset (pages, 0, PGSIZE * page_cnt);
+#ifdef HEAP_STATS
+      pool->blocks[page_idx].site = heapstat_alloc (caller, true,
+                                                    PGSIZE * page_cnt);
+#endif
     }
   else 
     {
@@ -100,24 +199,12 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   return pages;
 }
 
-/* Obtains a single free page and returns its kernel virtual
-   address.
-   If PAL_USER is set, the page is obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the page is filled with zeros.  If no pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
-void *
-palloc_get_page (enum palloc_flags flags) 
-{
-  return palloc_get_multiple (flags, 1);
-}
-
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -133,12 +220,20 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 
   page_idx = pg_no (pages) - pg_no (pool->base);
 
+#ifdef HEAP_STATS
+  heapstat_free (pool->blocks[page_idx].site, PGSIZE * page_cnt);
+  pool->blocks[page_idx].site = NULL;
+#endif
+
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  free_range (pool, page_idx, page_cnt);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +243,88 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes a free page in advance for a later PAL_ZERO request.
+   Called by the idle thread whenever it runs.  Returns true if a
+   page was zeroed, false if the zeroed reserve is full or no
+   page is free. */
+bool
+palloc_prezero (void)
+{
+  return prezero_page (&kernel_pool) || prezero_page (&user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's used_map and block table at its base.
+     Calculate the space needed for them and subtract it from
+     the pool's size. */
+  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt)
+                                  + page_cnt * sizeof *p->blocks, PGSIZE);
+  size_t bm_size;
+  size_t i;
+  int order;
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  /* Initialize the pool.  The block table follows the used
+     map. */
+  bm_size = bitmap_buf_size (page_cnt);
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->blocks = (struct block *) ((uint8_t *) base + bm_size);
+  for (order = 0; order <= MAX_ORDER; order++)
+    list_init (&p->free_lists[order]);
+  list_init (&p->zeroed);
+  p->zeroed_cnt = 0;
+  p->page_cnt = page_cnt;
   p->base = base + bm_pages * PGSIZE;
+
+  /* Every page starts out free, carved into the largest
+     aligned blocks that fit. */
+  for (i = 0; i < page_cnt; i++)
+    {
+      p->blocks[i].order = -1;
+#ifdef HEAP_STATS
+      p->blocks[i].site = NULL;
+#endif
+    }
+  free_range (p, 0, page_cnt);
+}
+
+/* Takes one free page of POOL, zeroes it, and adds it to the
+   pool's zeroed reserve.  Returns true if successful.  The pool
+   is only touched with interrupts off, so the idle thread never
+   blocks here, but the page is cleared with interrupts on, once
+   it has been marked used so nobody else can take it. */
+static bool
+prezero_page (struct pool *pool)
+{
+  enum intr_level old_level;
+  size_t page_idx = BITMAP_ERROR;
+
+  old_level = intr_disable ();
+  if (pool->zeroed_cnt < ZEROED_MAX)
+    {
+      page_idx = alloc_block (pool, 0);
+      if (page_idx != BITMAP_ERROR)
+        bitmap_mark (pool->used_map, page_idx);
+    }
+  intr_set_level (old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  memset (pool->base + PGSIZE * page_idx, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  list_push_back (&pool->zeroed, &pool->blocks[page_idx].elem);
+  pool->zeroed_cnt++;
+  intr_set_level (old_level);
+  return true;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +334,118 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first, or BITMAP_ERROR if no block is large
+   enough.  Interrupts must be off. */
+static size_t
+alloc_range (struct pool *pool, size_t page_cnt)
+{
+  size_t block_cnt;
+  size_t page_idx;
+  int order = 0;
+
+  while (((size_t) 1 << order) < page_cnt)
+    if (++order > MAX_ORDER)
+      return BITMAP_ERROR;
+  block_cnt = (size_t) 1 << order;
+
+  page_idx = alloc_block (pool, order);
+  if (page_idx != BITMAP_ERROR && block_cnt > page_cnt)
+    free_range (pool, page_idx + page_cnt, block_cnt - page_cnt);
+  return page_idx;
+}
+
+/* Removes a free block of 2**ORDER pages from POOL, splitting a
+   larger one if necessary, and returns the index of its first
+   page, or BITMAP_ERROR if there is none.  Interrupts must be
+   off. */
+static size_t
+alloc_block (struct pool *pool, int order)
+{
+  int k;
+
+  for (k = order; k <= MAX_ORDER; k++)
+    if (!list_empty (&pool->free_lists[k]))
+      {
+        struct list_elem *e = list_pop_front (&pool->free_lists[k]);
+        struct block *b = list_entry (e, struct block, elem);
+        size_t page_idx = b - pool->blocks;
+
+        /* Put back the upper half at each split. */
+        b->order = -1;
+        while (k > order)
+          {
+            struct block *half;
+
+            k--;
+            half = &pool->blocks[page_idx + ((size_t) 1 << k)];
+            half->order = k;
+            list_push_front (&pool->free_lists[k], &half->elem);
+          }
+        return page_idx;
+      }
+  return BITMAP_ERROR;
+}
+
+/* Returns the PAGE_CNT pages starting at PAGE_IDX to POOL as the
+   largest aligned blocks that cover them.  Interrupts must be
+   off. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order < MAX_ORDER
+             && (page_idx & ((size_t) 1 << order)) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Returns the block of 2**ORDER pages starting at PAGE_IDX to
+   POOL, merging it with its buddy for as long as the buddy is
+   free.  Interrupts must be off. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order)
+{
+  while (order < MAX_ORDER)
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+
+      if (buddy >= pool->page_cnt || pool->blocks[buddy].order != order)
+        break;
+      list_remove (&pool->blocks[buddy].elem);
+      pool->blocks[buddy].order = -1;
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+  pool->blocks[page_idx].order = order;
+  list_push_front (&pool->free_lists[order], &pool->blocks[page_idx].elem);
+}
+
+/* Returns every page in POOL's zeroed reserve to the free lists.
+   Interrupts must be off. */
+static void
+release_zeroed (struct pool *pool)
+{
+  while (!list_empty (&pool->zeroed))
+    {
+      struct list_elem *e = list_pop_front (&pool->zeroed);
+      size_t page_idx = list_entry (e, struct block, elem) - pool->blocks;
+
+      bitmap_reset (pool->used_map, page_idx);
+      free_block (pool, page_idx, 0);
+    }
+  pool->zeroed_cnt = 0;
+}
@@ -0,0 +1,245 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   Each kernel type that is allocated and freed often gets its
+   own cache.  A cache hands out objects of exactly the type's
+   size from page-sized "slabs".  The slab's header at the start
+   of the page keeps a stack of the indexes of its free objects,
+   so freed objects are never written to by the allocator.  That
+   lets a cache run a constructor once per object, when its slab
+   is created, instead of once per allocation: callers free
+   objects in their constructed state and get them back that way.
+
+   Slabs with free objects are kept on the cache's slab list,
+   partly used ones at the front so that allocations fill them
+   first and fully free ones at the back.  One fully free slab is
+   kept warm per cache; further ones go back to the page
+   allocator. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Slab header, at the start of each slab's page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in one of cache's lists. */
+    size_t free_cnt;            /* Number of free objects. */
+    uint16_t free_idx[];        /* Stack of free object indexes. */
+  };
+
+/* All caches, for statistics. */
+static struct list all_caches = LIST_INITIALIZER (all_caches);
+
+static struct slab *slab_create (struct kmem_cache *);
+static struct slab *obj_to_slab (struct kmem_cache *, void *);
+static void *slab_to_obj (struct kmem_cache *, struct slab *, size_t idx);
+
+/* Initializes cache C for objects of SIZE bytes, naming it NAME
+   for statistics.  CTOR, if nonnull, is run on each object when
+   its slab is created.  Caches are set up during boot, before
+   other threads can use them. */
+void
+kmem_cache_init (struct kmem_cache *c, const char *name, size_t size,
+                 kmem_ctor_func *ctor)
+{
+  size_t n;
+
+  ASSERT (size > 0);
+
+  c->name = name;
+  c->obj_size = ROUND_UP (size, sizeof (void *));
+  c->ctor = ctor;
+
+  /* Fit as many objects as we can after the header and its
+     free index stack. */
+  n = (PGSIZE - sizeof (struct slab)) / (c->obj_size + sizeof (uint16_t));
+  while (n > 0 && ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+                            sizeof (void *)) + n * c->obj_size > PGSIZE)
+    n--;
+  ASSERT (n > 0);
+  c->objs_per_slab = n;
+  c->obj_ofs = ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+                         sizeof (void *));
+
+  list_init (&c->slabs);
+  list_init (&c->full_slabs);
+  c->empty_cnt = 0;
+  lock_init (&c->lock);
+  list_push_back (&all_caches, &c->elem);
+
+  c->slab_cnt = 0;
+  c->active_cnt = 0;
+  c->peak_cnt = 0;
+  c->allocs = 0;
+  c->frees = 0;
+}
+
+/* Allocates and returns an object from cache C, or a null
+   pointer if memory is not available.  If C has a constructor,
+   the object is in its constructed state; otherwise its contents
+   are undefined. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&c->lock);
+  if (list_empty (&c->slabs))
+    {
+      s = slab_create (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+      list_push_back (&c->slabs, &s->elem);
+      c->empty_cnt++;
+    }
+
+  s = list_entry (list_front (&c->slabs), struct slab, elem);
+  if (s->free_cnt == c->objs_per_slab)
+    c->empty_cnt--;
+  obj = slab_to_obj (c, s, s->free_idx[--s->free_cnt]);
+  if (s->free_cnt == 0)
+    {
+      list_remove (&s->elem);
+      list_push_front (&c->full_slabs, &s->elem);
+    }
+
+  c->allocs++;
+  if (++c->active_cnt > c->peak_cnt)
+    c->peak_cnt = c->active_cnt;
+  lock_release (&c->lock);
+  return obj;
+}
+
+/* Returns OBJ, which must have been allocated from cache C, to
+   C. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+
+  if (obj == NULL)
+    return;
+  s = obj_to_slab (c, obj);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs, unless
+     it has to stay constructed. */
+  if (c->ctor == NULL)
+    memset (obj, 0xcc, c->obj_size);
+#endif
+
+  lock_acquire (&c->lock);
+  ASSERT (s->free_cnt < c->objs_per_slab);
+  if (s->free_cnt == 0)
+    {
+      /* Full slab has a free object again. */
+      list_remove (&s->elem);
+      list_push_front (&c->slabs, &s->elem);
+    }
+  s->free_idx[s->free_cnt++]
+    = ((uint8_t *) obj - ((uint8_t *) s + c->obj_ofs)) / c->obj_size;
+
+  if (s->free_cnt == c->objs_per_slab)
+    {
+      /* Keep one empty slab warm, give back the rest. */
+      list_remove (&s->elem);
+      if (c->empty_cnt > 0)
+        {
+          s->magic = 0;
+          palloc_free_page (s);
+          c->slab_cnt--;
+        }
+      else
+        {
+          list_push_back (&c->slabs, &s->elem);
+          c->empty_cnt++;
+        }
+    }
+
+  c->frees++;
+  c->active_cnt--;
+  lock_release (&c->lock);
+}
+
+/* Prints statistics for every cache. */
+void
+kmem_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+      printf ("Slab %s: %zu-byte objects, %zu in use (peak %zu), "
+              "%zu slabs, %"PRId64" allocs, %"PRId64" frees\n",
+              c->name, c->obj_size, c->active_cnt, c->peak_cnt,
+              c->slab_cnt, c->allocs, c->frees);
+    }
+}
+
+/* Obtains a page for a new slab of cache C and constructs its
+   objects.  Returns the slab, or a null pointer if memory is not
+   available.  C's lock must be held. */
+static struct slab *
+slab_create (struct kmem_cache *c)
+{
+  struct slab *s;
+  size_t i;
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free_cnt = c->objs_per_slab;
+  for (i = 0; i < c->objs_per_slab; i++)
+    {
+      /* Hand out low addresses first. */
+      s->free_idx[i] = c->objs_per_slab - i - 1;
+      if (c->ctor != NULL)
+        c->ctor (slab_to_obj (c, s, i));
+    }
+  c->slab_cnt++;
+  return s;
+}
+
+/* Returns the slab of cache C that OBJ is inside. */
+static struct slab *
+obj_to_slab (struct kmem_cache *c, void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  /* Check that the slab is valid and the object properly
+     aligned in it. */
+  ASSERT (s != NULL);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+  ASSERT (pg_ofs (obj) >= c->obj_ofs);
+  ASSERT ((pg_ofs (obj) - c->obj_ofs) % c->obj_size == 0);
+
+  return s;
+}
+
+/* Returns the IDX'th object in slab S of cache C. */
+static void *
+slab_to_obj (struct kmem_cache *c, struct slab *s, size_t idx)
+{
+  ASSERT (idx < c->objs_per_slab);
+  return (uint8_t *) s + c->obj_ofs + idx * c->obj_size;
+}
@@ -0,0 +1,43 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+/* Constructor run once on each object when its slab is created.
+   Objects must be handed back to kmem_cache_free() in the same
+   constructed state, so that the next allocation can skip it. */
+typedef void kmem_ctor_func (void *obj);
+
+/* A cache of equally sized objects of one type, carved out of
+   page-sized slabs. */
+struct kmem_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    size_t obj_ofs;             /* Offset of first object in a slab. */
+    kmem_ctor_func *ctor;       /* Constructor, or a null pointer. */
+    struct list slabs;          /* Slabs with free objects. */
+    struct list full_slabs;     /* Slabs with no free objects. */
+    size_t empty_cnt;           /* Slabs with every object free. */
+    struct lock lock;           /* Mutual exclusion. */
+    struct list_elem elem;      /* Element in list of all caches. */
+
+    /* Statistics. */
+    size_t slab_cnt;            /* Slabs held. */
+    size_t active_cnt;          /* Objects allocated. */
+    size_t peak_cnt;            /* Most objects ever allocated. */
+    int64_t allocs;             /* Calls to kmem_cache_alloc(). */
+    int64_t frees;              /* Calls to kmem_cache_free(). */
+  };
+
+void kmem_cache_init (struct kmem_cache *, const char *name, size_t size,
+                      kmem_ctor_func *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_print_stats (void);
+
+#endif /* threads/slab.h */
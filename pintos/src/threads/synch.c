@@ -39,6 +39,99 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+static heap_less_func compare_priorities_wait;
+static void sema_wake (struct semaphore *);
+static void lock_drop (struct lock *);
+
+/* Initializes wait queue WQ as empty. */
+void
+wait_queue_init (struct wait_queue *wq)
+{
+  ASSERT (wq != NULL);
+
+  heap_init (&wq->threads, compare_priorities_wait, NULL);
+  wq->next_seq = 0;
+}
+
+/* Adds thread T, which is about to block, to WQ.  Interrupts
+   must be off. */
+void
+wait_queue_push (struct wait_queue *wq, struct thread *t)
+{
+  ASSERT (wq != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->wait_queue == NULL);
+
+  t->wait_queue = wq;
+  t->wait_seq = wq->next_seq++;
+  heap_insert (&wq->threads, &t->wait_elem);
+}
+
+/* Removes the highest priority thread from WQ and returns it, or
+   returns a null pointer if WQ is empty.  Interrupts must be
+   off. */
+struct thread *
+wait_queue_pop (struct wait_queue *wq)
+{
+  struct thread *t;
+
+  ASSERT (wq != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (heap_empty (&wq->threads))
+    return NULL;
+  t = heap_entry (heap_pop_min (&wq->threads), struct thread, wait_elem);
+  t->wait_queue = NULL;
+  return t;
+}
+
+/* Returns the highest priority thread in WQ without removing it,
+   or a null pointer if WQ is empty. */
+struct thread *
+wait_queue_front (const struct wait_queue *wq)
+{
+  ASSERT (wq != NULL);
+
+  if (heap_empty (&wq->threads))
+    return NULL;
+  return heap_entry (heap_min (&wq->threads), struct thread, wait_elem);
+}
+
+/* Returns true if no thread is waiting in WQ. */
+bool
+wait_queue_empty (const struct wait_queue *wq)
+{
+  ASSERT (wq != NULL);
+
+  return heap_empty (&wq->threads);
+}
+
+/* Moves thread T to its place in the wait queue it is blocked
+   in, if any, after its priority has changed.  Interrupts must
+   be off. */
+void
+wait_queue_update (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->wait_queue != NULL)
+    heap_update (&t->wait_queue->threads, &t->wait_elem);
+}
+
+/* Returns true if waiting thread A should be woken before waiting
+   thread B: it has a higher priority, or the same priority and
+   arrived first. */
+static bool
+compare_priorities_wait (const struct heap_elem *a,
+                         const struct heap_elem *b, void *aux UNUSED)
+{
+  const struct thread *t1 = heap_entry (a, struct thread, wait_elem);
+  const struct thread *t2 = heap_entry (b, struct thread, wait_elem);
+
+  if (t1->priority != t2->priority)
+    return t1->priority > t2->priority;
+  return (int) (t1->wait_seq - t2->wait_seq) < 0;
+}
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -55,7 +148,7 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  wait_queue_init (&sema->waiters);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -76,9 +169,8 @@ sema_down (struct semaphore *sema)
 
   old_level = intr_disable ();
   while (sema->value == 0) {
-    /* Insert the thread based on its priority. */
-    list_insert_ordered (&sema->waiters, &thread_current()->elem,
-                         compare_priorities, NULL);
+    /* Wait in order of priority. */
+    wait_queue_push (&sema->waiters, thread_current ());
     thread_block ();
   }
   sema->value--;
@@ -124,17 +216,7 @@ sema_up (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
-
-  // Peijie Driving
-
-  /* Unblock the thread with highest priority. */
-  if (!list_empty (&sema->waiters)) {
-    /* Sort incase priority was changed while blocked. */
-    list_sort(&sema->waiters, compare_priorities, NULL);
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
-  }
-  sema->value++;
+  sema_wake (sema);
 
   /* Always check pre-emption after thread_unblock. */
   check_preemption();
@@ -142,6 +224,21 @@ sema_up (struct semaphore *sema)
   intr_set_level (old_level);
 }
 
+/* Increments SEMA's value and unblocks its highest priority
+   waiter, if any, without yielding to it.  Interrupts must be
+   off. */
+// Peijie Driving
+static void
+sema_wake (struct semaphore *sema)
+{
+  /* Unblock the thread with highest priority.  The queue keeps
+     itself in order when priorities change while blocked. */
+  if (!wait_queue_empty (&sema->waiters)) {
+    thread_unblock (wait_queue_pop (&sema->waiters));
+  }
+  sema->value++;
+}
+
 static void sema_test_helper (void *sema_);
 
 /* Self-test for semaphores that makes control "ping-pong"
@@ -200,30 +297,76 @@ lock_init (struct lock *lock)
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
-  lock->max_priority = 0;
   sema_init (&lock->semaphore, 1);
 }
 
+/* Returns the priority LOCK donates to its holder: that of its
+   highest priority waiter, or PRI_MIN if none. */
+static int
+lock_priority (const struct lock *lock)
+{
+  struct thread *t = wait_queue_front (&lock->semaphore.waiters);
+
+  return t != NULL ? t->priority : PRI_MIN;
+}
+
 /*
-* Compares the max_priority between two locks.
+* Compares the donated priority between two locks.
 *
 * a - the element to be inserted
-* b - the element already in the list
+* b - the element already in the heap
 *
-* Returns true if the max_priority of a is less than that of b.
+* Returns true if lock a donates a higher priority than lock b, so
+* that a thread's held_locks heap has the highest donation on top.
 */
-bool compare_priorities_lock(const struct list_elem *a,
-                   const struct list_elem *b,
-                   void *aux) {
+bool compare_priorities_lock(const struct heap_elem *a,
+                   const struct heap_elem *b,
+                   void *aux UNUSED) {
   struct lock *l1 = NULL;
   struct lock *l2 = NULL;
 
   /* Gets the locks that contains element a and b. */
-  l1 = list_entry (a, struct lock, holding_elem);
-  l2 = list_entry (b, struct lock, holding_elem);
+  l1 = heap_entry (a, struct lock, holding_elem);
+  l2 = heap_entry (b, struct lock, holding_elem);
+
+  /* Returns the comparison between donated priorities. */
+  return lock_priority (l1) > lock_priority (l2);
+}
+
+/* Recomputes T's priority as the higher of its own and the
+   highest donated to any lock it holds, and passes a change on
+   along the chain of lock holders that T is waiting behind.
+   Each step costs O(log n) in the number of waiters and held
+   locks, and the walk stops as soon as a priority is unchanged.
+   Interrupts must be off. */
+void
+lock_update_priority (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
 
-  /* Returns the comparison between wake up times. */
-  return l1->max_priority < l2->max_priority;
+  while (t != NULL)
+    {
+      struct lock *l;
+      int priority = t->old_priority;
+
+      if (!heap_empty (&t->held_locks))
+        {
+          l = heap_entry (heap_min (&t->held_locks), struct lock, holding_elem);
+          if (lock_priority (l) > priority)
+            priority = lock_priority (l);
+        }
+      if (priority == t->priority)
+        break;
+      /* This also moves T within the wait queue it is in. */
+      thread_change_priority (t, priority);
+
+      /* L's place among its holder's locks may have changed. */
+      l = t->waiting_lock;
+      if (l == NULL || l->holder == NULL)
+        break;
+      heap_update (&l->holder->held_locks, &l->holding_elem);
+      t = l->holder;
+    }
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -237,12 +380,13 @@ bool compare_priorities_lock(const struct list_elem *a,
 
 /*
 * Acquires lock if available.
-* Otherwise, add the lock to current thread's lock_waiting list.
+* Otherwise, wait in the lock's semaphore queue and donate the current
+* thread's priority along the chain of lock holders, again each time
+* the lock is lost to another thread after waking up.
 *
-* In a while loop, check whether donation is needed for the thread
-* we are checking. If the lock this thread is waiting for has a lower
-* priority, donate. Update the thread we are checking to this lock holder.
-* Stop when there is no more threads.
+* Once acquired, the lock goes into the current thread's held_locks
+* heap, and the threads still waiting for it donate to the current
+* thread instead.
 */
 // Yige, Pengdi, and Peijie Driving
 void
@@ -250,48 +394,33 @@ lock_acquire (struct lock *lock)
 {
 
   enum intr_level old_level;    /* Old interrupt level. */
-  struct lock *l = NULL;              /* Temp lock. */
-  struct thread *t = NULL;            /* Temp thread. */
-  struct list_elem *e = NULL;         /* Temp lock element. */
+  struct thread *cur = NULL;    /* Current thread. */
 
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
   old_level = intr_disable ();
+  cur = thread_current ();
 
-  if (lock->holder != NULL) {     /* Cannot acquire lock. */
-    /* Add add lock to thread's waiting list. */
-    list_push_back (&thread_current ()->lock_waiting, &lock->waiting_elem);
-
-    l = lock;
-    t = lock->holder;
+  while (!sema_try_down (&lock->semaphore)) {  /* Cannot acquire lock. */
+    cur->waiting_lock = lock;
+    wait_queue_push (&lock->semaphore.waiters, cur);
 
-    while(t != NULL && thread_current ()->priority > t->priority) {
-      /* Priority donation is needed.*/
-      t->priority = thread_current ()->priority;
-      if (t->priority > l->max_priority) {
-        l->max_priority = t->priority;
-      }
-
-      /* Get next lock thread is waiting for and lock holder
-         who may be a donee. */
-      if (list_empty(&t->lock_waiting)) {
-        break;
-      }
-      e = list_begin (&t->lock_waiting);
-      l = list_entry(e, struct lock, waiting_elem);
-      t = l->holder;
+    /* The MLFQS scheduler does not donate priority. */
+    if (lock->holder != NULL && !thread_mlfqs) {
+      heap_update (&lock->holder->held_locks, &lock->holding_elem);
+      lock_update_priority (lock->holder);
     }
+    thread_block ();
   }
+  cur->waiting_lock = NULL;
 
-  sema_down (&lock->semaphore);
-
-  /* Current thread now has the lock. Update list of locks holding. */
-  list_insert_ordered (&thread_current ()->lock_holding,
-                         &lock->holding_elem, compare_priorities_lock, NULL);
-
-  lock->holder = thread_current ();
+  /* Current thread now has the lock. Update heap of locks holding. */
+  lock->holder = cur;
+  heap_insert (&cur->held_locks, &lock->holding_elem);
+  if (!thread_mlfqs)
+    lock_update_priority (cur);
 
   intr_set_level (old_level);
 }
@@ -305,14 +434,22 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      heap_insert (&lock->holder->held_locks, &lock->holding_elem);
+      if (!thread_mlfqs)
+        lock_update_priority (lock->holder);
+    }
+  intr_set_level (old_level);
   return success;
 }
 
@@ -325,67 +462,46 @@ lock_try_acquire (struct lock *lock)
 /*
 * Release lock.
 *
-* Update max_priority of this lock to the next highest priority
-* of threads waiting for this lock.
-*
-* Update current thread's priority to the next highest max_priority
-* of the locks it holds, which should be the second highest donor's priority
-* if nested donation happened. Else, return to old priority.
+* Remove the lock from the current thread's held_locks heap, and
+* recompute the current thread's priority from the highest donation
+* to the locks it still holds, which should be the second highest
+* donor's priority if nested donation happened. Else, return to old
+* priority.
 *
 */
 // Yige, Pengdi, and Peijie Driving
 void
 lock_release (struct lock *lock)
 {
-  /* Second list element in lock waiting list. */
-  struct list_elem *second = NULL;
-  /* Waiting thread with highest priority. */
-  struct thread *t = NULL;
-  /* Elemant with highest lock max priority. */
-  struct list_elem *max = NULL;
-  /* Lock with highest priority in holding list.*/
-  struct lock *l = NULL;
-  /* Current thread. */
-  struct thread *curr = NULL;
+  enum intr_level old_level;
 
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
-  enum intr_level old_level;
-
   old_level = intr_disable ();
+  lock_drop (lock);
 
-  /* Update lock's priority to the highest priority of waiting threads. */
-  if (list_size(&(&lock->semaphore)->waiters) > 1) {
-    second = list_next( list_begin(&(&lock->semaphore)->waiters));
-    t = list_entry (second, struct thread, elem);
-    lock->max_priority = t->priority;
-  } else {
-    lock->max_priority = 0;
-  }
+  /* Always check pre-emption after thread_unblock. */
+  check_preemption ();
+
+  intr_set_level (old_level);
+}
 
+/* Releases LOCK, which must be owned by the current thread, and
+   wakes its highest priority waiter without yielding to it.
+   Interrupts must be off. */
+static void
+lock_drop (struct lock *lock)
+{
   /* This lock is no longer held by thread. */
-  list_remove(&lock->holding_elem);
-
-  curr = thread_current();
-
-  /* Update current thread's priority. */
-  if (!list_empty(&curr->lock_holding)) {
-    max = list_max(&curr->lock_holding, compare_priorities_lock, NULL);
-    l = list_entry (max, struct lock, holding_elem);
-    if (l->max_priority > curr-> old_priority) {  /* Nest donation happened. */
-      curr-> priority = l->max_priority;
-    } else {    /* Keep the higher old_priority. */
-      curr-> priority = curr-> old_priority;
-    }
-  } else {  /* No more donation happened. */
-    curr-> priority = curr-> old_priority;
-  }
+  heap_remove (&thread_current ()->held_locks, &lock->holding_elem);
 
-  lock->holder = NULL;
-  sema_up (&lock->semaphore);
+  /* Update current thread's priority, unless set by the scheduler. */
+  if (!thread_mlfqs)
+    lock_update_priority (thread_current ());
 
-  intr_set_level (old_level);
+  lock->holder = NULL;
+  sema_wake (&lock->semaphore);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -399,14 +515,6 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
-struct semaphore_elem
-{
-  int priority;                       /* Priority. */
-  struct list_elem elem;              /* List element. */
-  struct semaphore semaphore;         /* This semaphore. */
-};
-
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -415,32 +523,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
-}
-
-/*
-* Compares the priorities between two semaphores.
-*
-* a - the element to be inserted
-* b - the element already in the list
-*
-* Returns true if the priority of a is less than that of b.
-*
-* Used in cond_wait.
-*/
-// Peijie Driving
-static bool compare_priorities_sema(const struct list_elem *a,
-                   const struct list_elem *b,
-                   void *aux) {
-  struct semaphore_elem *s1 = NULL;
-  struct semaphore_elem *s2 = NULL;
-
-  /* Gets the semaphore that contains elements a and b. */
-  s1 = list_entry (a, struct semaphore_elem, elem);
-  s2 = list_entry (b, struct semaphore_elem, elem);
-
-  /* Returns the comparison between priorities. */
-  return s1->priority > s2->priority;
+  wait_queue_init (&cond->waiters);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -466,25 +549,26 @@ static bool compare_priorities_sema(const struct list_elem *a,
 void
 cond_wait (struct condition *cond, struct lock *lock)
 {
-  struct semaphore_elem waiter;
+  enum intr_level old_level;    /* Old interrupt level. */
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  sema_init (&waiter.semaphore, 0);
-
-  waiter.priority = thread_current()->priority;
+  old_level = intr_disable ();
 
   // Peijie Driving
 
-  /* Insert the waiter based on its priority. */
-  list_insert_ordered (&cond->waiters, &waiter.elem,
-                          compare_priorities_sema, NULL);
+  /* Wait in order of priority.  Release the lock and block
+     without yielding in between, so that no signal can arrive
+     while we are queued but not blocked.  A thread woken by the
+     release runs once we block. */
+  wait_queue_push (&cond->waiters, thread_current ());
+  lock_drop (lock);
+  thread_block ();
 
-  lock_release (lock);
-  sema_down (&waiter.semaphore);
+  intr_set_level (old_level);
   lock_acquire (lock);
 }
 
@@ -498,15 +582,21 @@ cond_wait (struct condition *cond, struct lock *lock)
 void
 cond_signal (struct condition *cond, struct lock *lock UNUSED)
 {
+  enum intr_level old_level;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters)) {
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+  old_level = intr_disable ();
+  if (!wait_queue_empty (&cond->waiters)) {
+    thread_unblock (wait_queue_pop (&cond->waiters));
+
+    /* Always check pre-emption after thread_unblock. */
+    check_preemption ();
   }
+  intr_set_level (old_level);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -521,6 +611,6 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
-  while (!list_empty (&cond->waiters))
+  while (!wait_queue_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
@@ -1,14 +1,38 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
 
+struct thread;
+
+/* Priority wait queue.
+
+   Threads blocked on a semaphore, lock, or condition variable,
+   highest priority first and in arrival order among equals.
+   Adding a thread, removing the highest priority one, and
+   repositioning one whose priority changed, as donation does,
+   each take O(log n) time.  A thread waits in at most one queue
+   at a time. */
+struct wait_queue
+  {
+    struct heap threads;        /* Waiting threads. */
+    unsigned next_seq;          /* Arrival number for the next thread. */
+  };
+
+void wait_queue_init (struct wait_queue *);
+void wait_queue_push (struct wait_queue *, struct thread *);
+struct thread *wait_queue_pop (struct wait_queue *);
+struct thread *wait_queue_front (const struct wait_queue *);
+bool wait_queue_empty (const struct wait_queue *);
+void wait_queue_update (struct thread *);
+
 /* A counting semaphore. */
 struct semaphore
 {
   unsigned value;             /* Current value. */
-  struct list waiters;        /* List of waiting threads. */
+  struct wait_queue waiters;  /* Queue of waiting threads. */
 };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -23,10 +47,7 @@ struct lock
   struct thread *holder;            /* Thread holding lock. */
   struct semaphore semaphore;       /* Binary semaphore controlling access. */
 
-  struct list_elem holding_elem;    /* Added to lock_holding list of thread. */
-  struct list_elem waiting_elem;    /* Added to lock_waiting list of thread. */
-
-  int max_priority;     /* Highest priority out of threads waiting for lock. */
+  struct heap_elem holding_elem;    /* Added to held_locks heap of holder. */
 };
 
 void lock_init (struct lock *);
@@ -34,11 +55,13 @@ void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_update_priority (struct thread *);
+heap_less_func compare_priorities_lock;
 
 /* Condition variable. */
 struct condition
 {
-  struct list waiters;        /* List of waiting threads. */
+  struct wait_queue waiters;  /* Queue of waiting threads. */
 };
 
 void cond_init (struct condition *);
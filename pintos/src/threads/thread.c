@@ -10,6 +10,7 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
@@ -17,9 +18,12 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "userprog/process.h"
 #include "userprog/syscall.h"
+#ifdef VM
+#include "vm/wset.h"
+#endif
 
 #ifdef USERPROG
 
@@ -30,9 +34,15 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queue of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is one FIFO list per priority, and bit P of ready_mask
+   is set whenever ready_lists[P] is nonempty, so the highest
+   priority ready thread is found with a bit scan no matter how
+   many threads are ready. */
+static struct list ready_lists[PRI_MAX + 1];
+static uint64_t ready_mask;
+static size_t ready_cnt;        /* Number of threads in ready_lists. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -69,6 +79,18 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* MLFQS state.  load_avg is the system load average.  Only the
+   running thread's recent_cpu grows between the once-a-second
+   updates, so only the threads that ran in the current time
+   slice, recorded in mlfqs_ran, need their priorities
+   recomputed at its end.  If more threads ran than mlfqs_ran
+   holds, mlfqs_ran_overflow is set and every priority is
+   recomputed instead. */
+static fixed_t load_avg;
+static struct thread *mlfqs_ran[TIME_SLICE];
+static size_t mlfqs_ran_cnt;
+static bool mlfqs_ran_overflow;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -80,6 +102,14 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_max_priority (void);
+static void mlfqs_tick (struct thread *);
+static void mlfqs_end_slice (void);
+static void mlfqs_update_priority (struct thread *);
+static thread_action_func mlfqs_update_recent_cpu;
+static thread_action_func mlfqs_recompute_priority;
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -97,11 +127,19 @@ static tid_t allocate_tid (void);
 void
 thread_init (void)
 {
+  int pri;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    list_init (&ready_lists[pri]);
+  ready_mask = 0;
+  ready_cnt = 0;
   list_init (&all_list);
+  load_avg = 0;
+  mlfqs_ran_cnt = 0;
+  mlfqs_ran_overflow = false;
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -138,17 +176,144 @@ thread_tick (void)
   if (t == idle_thread)
     idle_ticks++;
 #ifdef USERPROG
-  else if (t->pagedir != NULL)
+  else if (t->pagedir != NULL && !t->exited)
     user_ticks++;
 #endif
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
+/* Called by the timer when CNT ticks passed without a timer
+   interrupt, IDLE telling whether the idle thread ran meanwhile.
+   Ends the MLFQS time slice if one ended among them, since
+   mlfqs_tick() does not see those ticks.  Interrupts must be
+   off. */
+void
+thread_skip_ticks (int64_t cnt, bool idle)
+{
+  int64_t now = timer_ticks ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (idle)
+    idle_ticks += cnt;
+  if (thread_mlfqs && now / TIME_SLICE != (now - cnt) / TIME_SLICE)
+    mlfqs_end_slice ();
+}
+
+/* Updates the MLFQS statistics for a timer tick during which CUR
+   was running, and recomputes priorities when they are due.
+   Runs in the timer interrupt, so besides the once-a-second
+   recent_cpu decay over all threads, the work is proportional
+   only to the few threads that ran in the last time slice. */
+static void
+mlfqs_tick (struct thread *cur)
+{
+  int64_t now = timer_ticks ();
+  bool idle = cur == idle_thread;
+
+  if (!idle)
+    {
+      cur->recent_cpu = fix_add_int (cur->recent_cpu, 1);
+      if (mlfqs_ran_cnt == 0 || mlfqs_ran[mlfqs_ran_cnt - 1] != cur)
+        {
+          if (mlfqs_ran_cnt < TIME_SLICE)
+            mlfqs_ran[mlfqs_ran_cnt++] = cur;
+          else
+            mlfqs_ran_overflow = true;
+        }
+    }
+
+  if (now % TIMER_FREQ == 0)
+    {
+      /* load_avg = (59/60) * load_avg + (1/60) * ready_threads. */
+      int ready_threads = ready_cnt + !idle;
+      load_avg = (fix_mul (fix_int (59) / 60, load_avg)
+                  + fix_int (ready_threads) / 60);
+
+      /* Every thread's recent_cpu decays, so every priority
+         changes. */
+      thread_foreach (mlfqs_update_recent_cpu, NULL);
+      mlfqs_ran_cnt = 0;
+      mlfqs_ran_overflow = false;
+    }
+  else if (now % TIME_SLICE == 0)
+    mlfqs_end_slice ();
+  else
+    return;
+
+  if (ready_max_priority () > cur->priority)
+    intr_yield_on_return ();
+}
+
+/* Recomputes the priorities of the threads that ran in the time
+   slice that just ended, or of every thread if too many did.
+   Interrupts must be off. */
+static void
+mlfqs_end_slice (void)
+{
+  size_t i;
+
+  if (mlfqs_ran_overflow)
+    thread_foreach (mlfqs_recompute_priority, NULL);
+  else
+    for (i = 0; i < mlfqs_ran_cnt; i++)
+      mlfqs_update_priority (mlfqs_ran[i]);
+  mlfqs_ran_cnt = 0;
+  mlfqs_ran_overflow = false;
+}
+
+/* thread_foreach() function that recomputes T's priority.
+   Interrupts must be off. */
+static void
+mlfqs_recompute_priority (struct thread *t, void *aux UNUSED)
+{
+  if (t != idle_thread)
+    mlfqs_update_priority (t);
+}
+
+/* Decays T's recent_cpu by the load average and recomputes its
+   priority.  Interrupts must be off. */
+static void
+mlfqs_update_recent_cpu (struct thread *t, void *aux UNUSED)
+{
+  /* recent_cpu = (2 * load_avg) / (2 * load_avg + 1) * recent_cpu
+                  + nice. */
+  fixed_t twice_load = 2 * load_avg;
+
+  if (t == idle_thread)
+    return;
+  t->recent_cpu = fix_add_int (fix_mul (fix_div (twice_load,
+                                                 fix_add_int (twice_load, 1)),
+                                        t->recent_cpu),
+                               t->nice);
+  mlfqs_update_priority (t);
+}
+
+/* Recomputes T's MLFQS priority from its recent_cpu and nice
+   value, moving it to another run queue if necessary.
+   Interrupts must be off. */
+static void
+mlfqs_update_priority (struct thread *t)
+{
+  /* priority = PRI_MAX - (recent_cpu / 4) - (nice * 2). */
+  int priority = PRI_MAX - fix_trunc (t->recent_cpu / 4) - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  thread_change_priority (t, priority);
+  t->old_priority = priority;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void)
@@ -159,26 +324,22 @@ thread_print_stats (void)
 
 /* Checks whether or not preemption is needed by comparing
    the priority of current running thread and
-   the priority of the first thread in ready_list.
+   the highest priority in the run queue.
 
    The current thread should yield the processor to
    the new thread that has a higher priority. */
 // Yige, Pengdi, and Peijie Driving
 void check_preemption(void) {
   enum intr_level old_level;    /* Old interrupt level. */
-  struct thread *t = NULL;      /* Current thread called this function. */
 
   old_level = intr_disable ();
-  if (!list_empty (&ready_list)) {
-    /* Compare the priorities */
-    t = list_entry (list_begin (&ready_list), struct thread, elem);
-    if (t->priority > thread_current()->priority) {
-      /* The new thread has a higher priority, yield the processor. */
-      if (!intr_context ()) {
-        thread_yield();
-      } else {
-        intr_yield_on_return ();
-      }
+  /* Compare the priorities */
+  if (ready_max_priority () > thread_current()->priority) {
+    /* The new thread has a higher priority, yield the processor. */
+    if (!intr_context ()) {
+      thread_yield();
+    } else {
+      intr_yield_on_return ();
     }
   }
   intr_set_level (old_level);
@@ -215,8 +376,18 @@ thread_create (const char *name, int priority,
   if (t == NULL)
     return TID_ERROR;
 
-  /* Initialize thread. */
+  /* Initialize thread.  Under MLFQS the new thread inherits its
+     creator's nice and recent_cpu, which decide its priority.
+     The idle thread keeps PRI_MIN. */
   init_thread (t, name, priority);
+  if (thread_mlfqs && function != idle)
+    {
+      enum intr_level old_level = intr_disable ();
+      t->nice = thread_current ()->nice;
+      t->recent_cpu = thread_current ()->recent_cpu;
+      mlfqs_update_priority (t);
+      intr_set_level (old_level);
+    }
 
   t->tid = allocate_tid ();
 
@@ -285,30 +456,6 @@ thread_block (void)
   schedule ();
 }
 
-
-/*
-* Compares the priorities between two threads.
-*
-* a - the element to be inserted
-* b - the element already in the list
-*
-* Returns true if the priority of a is less than that of b.
-*/
-// Yige Driving
-bool compare_priorities(const struct list_elem *a,
-                   const struct list_elem *b,
-                   void *aux UNUSED) {
-  struct thread *t1 = NULL;
-  struct thread *t2 = NULL;
-
-  /* Gets the threads that contains element a and b. */
-  t1 = list_entry (a, struct thread, elem);
-  t2 = list_entry (b, struct thread, elem);
-
-  /* Returns the comparison between wake up times. */
-  return t1->priority > t2->priority;
-}
-
 /* Transitions a blocked thread T to the ready-to-run state.
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
@@ -329,13 +476,39 @@ thread_unblock (struct thread *t)
 
   // Pengdi Driving
 
-  /* Insert the thread based on its priority. */
-  list_insert_ordered (&ready_list, &t->elem, compare_priorities, NULL);
+  /* Queue the thread behind others of its priority. */
+  ready_push (t);
 
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
 
+/* Changes thread T's effective priority to PRIORITY, moving T
+   to the matching run queue if it is ready, or to its new place
+   in the wait queue it is blocked in, if any.  Does not preempt
+   the running thread.  Interrupts must be off. */
+void
+thread_change_priority (struct thread *t, int priority)
+{
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->priority == priority)
+    return;
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else
+    {
+      t->priority = priority;
+      wait_queue_update (t);
+    }
+}
+
 /* Returns the name of the running thread. */
 const char *
 thread_name (void)
@@ -376,8 +549,6 @@ thread_exit (void)
 {
   struct list_elem *e = NULL;       /* List elements. */
   struct thread *child = NULL;      /* Child threads. */
-  struct lock *l = NULL;            /* Locks holds. */
-  struct file_info *f_i = NULL;       /* Open files. */
 
   ASSERT (!intr_context ());
 
@@ -397,26 +568,14 @@ thread_exit (void)
   }
 
   /* Closes open files of current thread and frees resources. */
-  for (e = list_begin (&thread_current()->file_list);
-  e!= list_end (&thread_current()->file_list); e = list_next (e)) {
-    f_i = list_entry (e, struct file_info, file_elem);
-    e = e->prev;
-    list_remove(&f_i->file_elem);
-    close_file(f_i->file_temp);
-    free(f_i);
-  }
+  close_all_files (thread_current ());
 
   /* Releases all locks current thread holds. */
-  for (e = list_begin (&thread_current()->lock_holding);
-  e!= list_end (&thread_current()->lock_holding); e = list_next (e)) {
-    l = list_entry (e, struct lock, holding_elem);
-    lock_release(l);
+  while (!heap_empty (&thread_current()->held_locks)) {
+    lock_release (heap_entry (heap_min (&thread_current()->held_locks),
+                              struct lock, holding_elem));
   }
 
-  /* Close executable file of terminating thread,
-  allows write to file automatically. */
-  close_file(thread_current ()->executable);
-
   /* Notices parent that it exited. */
   sema_up(&thread_current()->wait_mutex);
   /* Waits for parent thread to reap. */
@@ -429,6 +588,16 @@ thread_exit (void)
 
   list_remove (&thread_current()->allelem);
   thread_current ()->status = THREAD_DYING;
+  if (thread_mlfqs)
+    {
+      /* Don't recompute our priority after we are gone. */
+      size_t i = 0;
+      while (i < mlfqs_ran_cnt)
+        if (mlfqs_ran[i] == thread_current ())
+          mlfqs_ran[i] = mlfqs_ran[--mlfqs_ran_cnt];
+        else
+          i++;
+    }
 
 
   schedule ();
@@ -449,9 +618,8 @@ thread_yield (void)
   if (cur != idle_thread) {
     // Pengdi Driving
 
-    /* Insert the thread based on its priority. */
-    list_insert_ordered (&ready_list, &cur->elem,
-                            compare_priorities, NULL);
+    /* Queue the thread behind others of its priority. */
+    ready_push (cur);
   }
   cur->status = THREAD_READY;
   schedule ();
@@ -481,13 +649,16 @@ thread_set_priority (int new_priority)
 {
   enum intr_level old_level;
 
+  /* The MLFQS scheduler sets priorities itself. */
+  if (thread_mlfqs)
+    return;
+
   old_level = intr_disable ();
-  if (thread_current ()->priority == thread_current ()->old_priority) {
-    // priority not donated
-    thread_current ()->priority = new_priority;
-  }
   thread_current ()->old_priority = new_priority;
 
+  /* Keep any higher priority donated through held locks. */
+  lock_update_priority (thread_current ());
+
   /* Always check pre-emption after priority has been changed. */
   check_preemption();
 
@@ -501,35 +672,56 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it no longer has the highest. */
 void
-thread_set_nice (int nice UNUSED)
+thread_set_nice (int nice)
 {
-  /* Not yet implemented. */
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  thread_current ()->nice = nice;
+  if (thread_mlfqs)
+    {
+      mlfqs_update_priority (thread_current ());
+      check_preemption ();
+    }
+  intr_set_level (old_level);
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level;
+  int load;
+
+  old_level = intr_disable ();
+  load = fix_round (100 * load_avg);
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level;
+  int recent_cpu;
+
+  old_level = intr_disable ();
+  recent_cpu = fix_round (100 * thread_current ()->recent_cpu);
+  intr_set_level (old_level);
+  return recent_cpu;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -550,10 +742,19 @@ idle (void *idle_started_ UNUSED)
 
   for (;;)
     {
+      /* Zero free pages ahead of time while there is nothing else
+         to do.  Any thread that becomes ready preempts us. */
+      while (palloc_prezero ())
+        continue;
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
 
+      /* Nothing to do until an interrupt arrives, so don't take
+         timer interrupts that have nothing to do either. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -625,12 +826,7 @@ init_thread (struct thread *t, const char *name, int priority)
   // Yige Driving
 
   // Project 1
-  /* Initializes semaphore for sleep to 0 so the thread will
-     be blocked when sema_down is called in timer_sleep. */
-  sema_init(&t->sleep_mutex, 0);
-
-  list_init (&t->lock_holding);
-  list_init (&t->lock_waiting);
+  heap_init (&t->held_locks, compare_priorities_lock, NULL);
 
   // Project 2
   list_init(&t->file_list);
@@ -640,6 +836,19 @@ init_thread (struct thread *t, const char *name, int priority)
   t->calling_exec = false;
   list_init(&t->child_list);
 
+#ifdef VM
+  list_init(&t->mmap_list);
+  t->next_mapid = 0;
+  t->last_fault = NULL;
+  t->fault_window = 0;
+  t->frame_cnt = 0;
+  t->frame_quota = FRAME_QUOTA_INIT;
+  t->wset_size = 0;
+  t->wset_accum = 0;
+  t->fault_cnt = 0;
+  t->vm_throttled = false;
+#endif
+
   t->child_elem.prev = NULL;
   t->child_elem.next = NULL;
 
@@ -688,10 +897,52 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void)
 {
-  if (list_empty (&ready_list))
+  int pri = ready_max_priority ();
+  struct thread *t;
+
+  if (pri < 0)
     return idle_thread;
+
+  t = list_entry (list_front (&ready_lists[pri]), struct thread, elem);
+  ready_remove (t);
+  return t;
+}
+
+/* Adds T to the back of the run queue for its priority.
+   Interrupts must be off. */
+static void
+ready_push (struct thread *t)
+{
+  list_push_back (&ready_lists[t->priority], &t->elem);
+  ready_mask |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Removes T from the run queue.  Interrupts must be off. */
+static void
+ready_remove (struct thread *t)
+{
+  list_remove (&t->elem);
+  if (list_empty (&ready_lists[t->priority]))
+    ready_mask &= ~((uint64_t) 1 << t->priority);
+  ready_cnt--;
+}
+
+/* Returns the highest priority of any ready thread, or -1 if no
+   thread is ready.  Interrupts must be off. */
+static int
+ready_max_priority (void)
+{
+  uint32_t high = ready_mask >> 32;
+  uint32_t low = ready_mask;
+
+  /* __builtin_clz() on 32 bits is a single BSR. */
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  else if (low != 0)
+    return 31 - __builtin_clz (low);
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    return -1;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -741,6 +992,11 @@ thread_schedule_tail (struct thread *prev)
      if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
      {
        ASSERT (prev != cur);
+#ifdef USERPROG
+       /* A process whose address space is still queued is freed
+          by the reaper instead. */
+       if (process_reaped (prev))
+#endif
        palloc_free_page(prev);
      }
 }
@@ -763,6 +1019,8 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  if (cur == idle_thread && next != idle_thread)
+    timer_idle_exit ();
   if (cur != next)
     prev = switch_threads (cur, next);
   thread_schedule_tail (prev);
@@ -2,8 +2,11 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
+#include <heap.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
 #include "threads/synch.h"
 
 /* States in a thread's life cycle. */
@@ -25,6 +28,10 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for MLFQS. */
+#define NICE_MIN -20                    /* Nicest. */
+#define NICE_MAX 20                     /* Least nice. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -91,23 +98,29 @@ struct thread
   char name[16];               /* Name (for debugging purposes). */
   uint8_t *stack;              /* Saved stack pointer. */
   int priority;                /* Priority. */
+  int nice;                    /* Niceness, for MLFQS. */
+  fixed_t recent_cpu;          /* Recent CPU time, for MLFQS. */
 
   struct list_elem allelem;    /* List element for all threads list. */
 
-  /* Shared between thread.c and synch.c. */
-  struct list_elem elem;       /* List element. */
+  struct list_elem elem;       /* Run queue element. */
 
   /* Project 1. */
   int64_t tick_to_wake;             /* When to wake up. */
-  struct semaphore sleep_mutex;     /* Used to wake up thread after sleep. */
+  uint64_t tsc_to_wake;             /* When to wake from a sub-tick sleep. */
 
   /* Used in timer.c */
-  struct list_elem sleep_elem;      /* Sleep_list element. */
+  struct heap_elem sleep_elem;      /* Sleep_heap or hrtimer_heap element. */
 
   int old_priority;                 /* Priority before donation. */
 
-  struct list lock_holding;         /* List of locks holding. */
-  struct list lock_waiting;         /* List of locks waiting for. */
+  struct heap held_locks;           /* Locks held, highest donation first. */
+  struct lock *waiting_lock;        /* Lock waiting for, or null. */
+
+  /* Used in synch.c */
+  struct wait_queue *wait_queue;    /* Wait queue blocked in, or null. */
+  struct heap_elem wait_elem;       /* Wait_queue element. */
+  unsigned wait_seq;                /* Arrival order in wait_queue. */
 
   /* Project 2. */
   struct list file_list;           /* List of open file */
@@ -132,6 +145,28 @@ struct thread
 #ifdef USERPROG
   /* Owned by userprog/process.c. */
   uint32_t *pagedir;                /* Page directory. */
+  bool exited;                      /* Address space queued for reaper? */
+  struct list_elem reap_elem;       /* List element for reaper. */
+#endif
+
+#ifdef VM
+  /* Owned by vm/page.c. */
+  struct hash pages;                /* Supplemental page table. */
+  void *user_esp;                   /* User stack pointer on syscall entry. */
+  void *last_fault;                 /* Page of last file-backed fault. */
+  int fault_window;                 /* Pages to read ahead on next fault. */
+
+  /* Owned by vm/wset.c. */
+  size_t frame_cnt;                 /* Frames holding this process's pages. */
+  size_t frame_quota;               /* Frames held before replacing own. */
+  size_t wset_size;                 /* Pages accessed in last interval. */
+  size_t wset_accum;                /* Pages accessed in this interval. */
+  int fault_cnt;                    /* Page faults in this interval. */
+  bool vm_throttled;                /* Delay page faults? */
+
+  /* Owned by vm/mmap.c. */
+  struct list mmap_list;            /* Memory-mapped files. */
+  int next_mapid;                   /* Next mapid for mmap. */
 #endif
 
   /* Owned by thread.c. */
@@ -147,6 +182,7 @@ void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_skip_ticks (int64_t cnt, bool idle);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -154,6 +190,7 @@ tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 void thread_block (void);
 void thread_unblock (struct thread *);
+void thread_change_priority (struct thread *, int priority);
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
@@ -175,8 +212,5 @@ int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
 void check_preemption(void);
-bool compare_priorities(const struct list_elem *a,
-  const struct list_elem *b,
-  void *aux);
 
 #endif /* threads/thread.h */
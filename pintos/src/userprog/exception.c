@@ -9,8 +9,13 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/uaccess.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -166,6 +171,35 @@ page_fault (struct intr_frame *f)
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
+#ifdef VM
+  /* Bring in the page if it belongs to the process, or copy it
+     if this is a write to a page shared copy-on-write.  A fault
+     in kernel context on a user address comes from a system call
+     touching user memory, so use the stack pointer saved on
+     entry to the system call. */
+  if (thread_current ()->pagedir != NULL && !thread_current ()->exited
+      && page_fault_in (fault_addr,
+                        user ? f->esp : thread_current ()->user_esp, write))
+    return;
+#endif
+
+  /* A bad pointer passed to a system call faults in one of the
+     user memory access routines.  Resume at its fixup, which
+     makes the access return failure. */
+  if (!user && uaccess_fixup (f))
+    return;
+
+#ifdef VM
+  if (!user && is_user_vaddr (fault_addr))
+    {
+      /* Bad pointer used outside the access routines, kill the
+         process. */
+      printf("%s: exit(%d)\n", thread_name(), -1);
+      thread_current()->exit_status = -1;
+      thread_exit ();
+    }
+#endif
+
   printf ("Page fault at %p: %s error %s page in %s context.\n",
           fault_addr,
           not_present ? "not present" : "rights violation",
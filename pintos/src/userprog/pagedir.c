@@ -7,6 +7,7 @@
 #include "threads/palloc.h"
 
 static uint32_t *active_pd (void);
+static void load_pagedir (uint32_t *);
 static void invalidate_pagedir (uint32_t *);
 
 /* Creates a new page directory that has mappings for kernel
@@ -47,6 +48,43 @@ pagedir_destroy (uint32_t *pd)
   palloc_free_page (pd);
 }
 
+/* Copies every user page mapped in SRC into a newly allocated
+   page mapped at the same address in DST, with the same
+   permissions.  Used by fork() when there is no virtual memory
+   system to share pages copy-on-write.  Returns false if memory
+   allocation fails; pages already copied stay in DST. */
+bool
+pagedir_copy (uint32_t *dst, uint32_t *src)
+{
+  uint32_t *pde;
+
+  for (pde = src; pde < src + pd_no (PHYS_BASE); pde++)
+    if (*pde & PTE_P)
+      {
+        uint32_t *pt = pde_get_pt (*pde);
+        uint32_t *pte;
+
+        for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
+          if (*pte & PTE_P)
+            {
+              void *upage = (void *) (((pde - src) << PDSHIFT)
+                                      | ((pte - pt) << PTSHIFT));
+              void *kpage = palloc_get_page (PAL_USER);
+
+              if (kpage == NULL)
+                return false;
+              memcpy (kpage, pte_get_page (*pte), PGSIZE);
+              if (!pagedir_set_page (dst, upage, kpage,
+                                     (*pte & PTE_W) != 0))
+                {
+                  palloc_free_page (kpage);
+                  return false;
+                }
+            }
+      }
+  return true;
+}
+
 /* Returns the address of the page table entry for virtual
    address VADDR in page directory PD.
    If PD does not have a page table for VADDR, behavior depends
@@ -80,6 +118,10 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
         return NULL;
     }
 
+  /* Kernel memory mapped with 4 MB pages has no page table. */
+  if (*pde & PTE_PS)
+    return NULL;
+
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
@@ -214,19 +256,43 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
     }
 }
 
+/* Sets the writable bit to WRITABLE in the PTE for user virtual
+   page VPAGE in PD.  Used to share pages copy-on-write. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable)
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL)
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else
+        *pte &= ~(uint32_t) PTE_W;
+      invalidate_pagedir (pd);
+    }
+}
+
 /* Loads page directory PD into the CPU's page directory base
-   register. */
+   register, unless it is already there.  Reloading the same page
+   directory would only flush the TLB for nothing. */
 void
 pagedir_activate (uint32_t *pd) 
 {
   if (pd == NULL)
     pd = init_page_dir;
 
-  /* Store the physical address of the page directory into CR3
-     aka PDBR (page directory base register).  This activates our
-     new page tables immediately.  See [IA32-v2a] "MOV--Move
-     to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
-     Address of the Page Directory". */
+  if (active_pd () != pd)
+    load_pagedir (pd);
+}
+
+/* Stores the physical address of page directory PD into CR3
+   aka PDBR (page directory base register).  This activates its
+   page tables immediately and flushes every TLB entry not marked
+   global.  See [IA32-v2a] "MOV--Move to/from Control Registers"
+   and [IA32-v3a] 3.7.5 "Base Address of the Page Directory". */
+static void
+load_pagedir (uint32_t *pd)
+{
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
@@ -256,8 +322,9 @@ invalidate_pagedir (uint32_t *pd)
 {
   if (active_pd () == pd) 
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
+      /* Reloading PD clears the TLB of user mappings, which are
+         never global.  See [IA32-v3a] 3.12 "Translation
+         Lookaside Buffers (TLBs)". */
+      load_pagedir (pd);
     } 
 }
@@ -17,6 +17,7 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
@@ -25,9 +26,41 @@
 #include "threads/vaddr.h"
 #include "threads/synch.h"
 #include "threads/malloc.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static thread_func reaper NO_RETURN;
+static bool reap_batch (void);
+static void reap (struct thread *);
+
+/* Exited processes whose address spaces await the reaper. */
+static struct list reap_list;
+
+/* The reaper thread, and whether it is blocked waiting for
+   reap_list to fill.  Protected by disabling interrupts. */
+static struct thread *reaper_thread;
+static bool reaper_idle;
+
+/* Passed from process_fork() to start_fork(). */
+struct fork_info
+{
+  struct thread *parent;          /* Process being forked. */
+  struct intr_frame if_;          /* Parent's user registers. */
+};
+
+/* Starts the reaper, which tears down the address spaces of
+   processes that have exited. */
+void
+process_init (void)
+{
+  list_init (&reap_list);
+  thread_create ("reaper", PRI_MIN, reaper, NULL);
+}
 
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
@@ -66,6 +99,8 @@ process_execute (const char *file_name)
 
   /* Create a new thread to execute FILE_NAME. */
   tid = thread_create (token, PRI_DEFAULT, start_process, fn_copy);
+  if (tid == TID_ERROR && process_reap_pending ())
+    tid = thread_create (token, PRI_DEFAULT, start_process, fn_copy);
 
   if (tid == TID_ERROR) {
     palloc_free_page (fn_copy);
@@ -125,6 +160,93 @@ if (thread_current()->current_directory == NULL) {
   NOT_REACHED ();
 }
 
+/* Starts a new process that is a copy of the current one, with
+   the same user memory, open files, and registers IF_, except
+   that fork() returns 0 in the child.  The parent waits until
+   the copy is complete.  Returns the new process's thread id,
+   or TID_ERROR if the process cannot be created. */
+tid_t
+process_fork (struct intr_frame *if_)
+{
+  struct fork_info info;
+  tid_t tid;
+
+  info.parent = thread_current ();
+  info.if_ = *if_;
+
+  /* The child is added to our child list and we block until it
+     has copied our address space, so INFO can live on our
+     stack. */
+  thread_current()->calling_exec = true;
+  tid = thread_create (thread_name (), PRI_DEFAULT, start_fork, &info);
+  if (tid == TID_ERROR && process_reap_pending ())
+    tid = thread_create (thread_name (), PRI_DEFAULT, start_fork, &info);
+  thread_current()->calling_exec = false;
+  return tid;
+}
+
+/* A thread function that copies the process described by
+   INFO_ into the new thread and starts it running. */
+static void
+start_fork (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *cur = thread_current ();
+  struct thread *parent = info->parent;
+  struct intr_frame if_ = info->if_;
+  bool success = false;
+
+  cur->pagedir = pagedir_create ();
+  if (cur->pagedir == NULL && process_reap_pending ())
+    cur->pagedir = pagedir_create ();
+  if (cur->pagedir == NULL)
+    goto done;
+#ifdef VM
+  /* Without a page table there is no address space to reap. */
+  if (!page_table_init ())
+    {
+      pagedir_destroy (cur->pagedir);
+      cur->pagedir = NULL;
+      goto done;
+    }
+#endif
+  process_activate ();
+
+  cur->executable = file_reopen (parent->executable);
+  if (cur->executable == NULL)
+    goto done;
+  file_deny_write (cur->executable);
+
+#ifdef VM
+  if (!page_table_copy (parent, cur->executable))
+    goto done;
+#else
+  if (!pagedir_copy (cur->pagedir, parent->pagedir))
+    goto done;
+#endif
+  success = copy_files (parent);
+
+ done:
+  if (!success) {
+    cur->tid = TID_ERROR;
+
+    /* Unblocks parent when the copy failed. */
+    sema_up(&cur->load_mutex);
+
+    printf("%s: exit(%d)\n", thread_name(), -1);
+    cur->exit_status = -1;
+    thread_exit ();
+  }
+
+  /* INFO is gone once the parent runs again. */
+  sema_up(&cur->load_mutex);
+
+  /* fork() returns 0 in the child. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -174,31 +296,130 @@ process_wait (tid_t child_tid)
   return result;
 }
 
-/* Free the current process's resources. */
+/* Free the current process's resources.  The address space is
+   handed to the reaper right away, so that exit does not take
+   longer for a process that used more memory, and so that it is
+   freed even if the parent never waits.  Only the struct thread
+   is kept for the parent.  The page directory stays valid until
+   the reaper destroys it, for the frames the process still maps,
+   but this thread no longer loads it.  The executable stays open
+   for its pages, but may be written again right away. */
 void
 process_exit (void)
 {
   struct thread *cur = thread_current ();
-  uint32_t *pd;
+  enum intr_level old_level;
+
+  if (cur->executable != NULL)
+    file_allow_write (cur->executable);
+  if (cur->pagedir == NULL)
+    return;
+
+  old_level = intr_disable ();
+  cur->exited = true;
+  pagedir_activate (NULL);
+  list_push_back (&reap_list, &cur->reap_elem);
+  if (reaper_idle)
+    {
+      reaper_idle = false;
+      thread_unblock (reaper_thread);
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns true if dying thread T may be freed, that is, if it
+   has no address space left for the reaper to tear down.
+   Otherwise the reaper frees T when it is done.  Called by the
+   scheduler with interrupts off. */
+bool
+process_reaped (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_DYING);
+
+  return t->pagedir == NULL;
+}
+
+/* Tears down the address spaces of the exited processes queued
+   so far in the calling thread, instead of leaving them to the
+   reaper, which runs only when nothing else is ready.  Called
+   when an allocation fails, before evicting or giving up.
+   Returns true if any process was reaped. */
+bool
+process_reap_pending (void)
+{
+  return reap_batch ();
+}
 
-  /* Destroy the current process's page directory and switch back
-     to the kernel-only page directory. */
-  pd = cur->pagedir;
-  if (pd != NULL)
+/* Reaper thread.  Takes every exited process queued so far and
+   tears down their address spaces in one batch, at a priority
+   below any process's. */
+static void
+reaper (void *aux UNUSED)
+{
+  reaper_thread = thread_current ();
+  for (;;)
     {
-      /* Correct ordering here is crucial.  We must set
-         cur->pagedir to NULL before switching page directories,
-         so that a timer interrupt can't switch back to the
-         process page directory.  We must activate the base page
-         directory before destroying the process's page
-         directory, or our active page directory will be one
-         that's been freed (and cleared). */
-      cur->pagedir = NULL;
-      pagedir_activate (NULL);
-      pagedir_destroy (pd);
+      enum intr_level old_level;
+
+      old_level = intr_disable ();
+      while (list_empty (&reap_list))
+        {
+          reaper_idle = true;
+          thread_block ();
+        }
+      intr_set_level (old_level);
+
+      reap_batch ();
     }
 }
 
+/* Takes every exited process queued so far off reap_list and
+   reaps them.  Returns true if there were any. */
+static bool
+reap_batch (void)
+{
+  struct list batch;
+  enum intr_level old_level;
+
+  list_init (&batch);
+  old_level = intr_disable ();
+  while (!list_empty (&reap_list))
+    list_push_back (&batch, list_pop_front (&reap_list));
+  intr_set_level (old_level);
+
+  if (list_empty (&batch))
+    return false;
+
+  while (!list_empty (&batch))
+    reap (list_entry (list_pop_front (&batch), struct thread, reap_elem));
+  return true;
+}
+
+/* Frees exited process T's pages, memory mappings, executable,
+   and page directory.  Frees T itself too if it has died in the
+   meantime; otherwise the scheduler frees it when it dies. */
+static void
+reap (struct thread *t)
+{
+  enum intr_level old_level;
+  uint32_t *pd = t->pagedir;
+
+#ifdef VM
+  page_table_destroy (t);
+  mmap_release (t);
+#endif
+  file_close (t->executable);
+
+  old_level = intr_disable ();
+  t->pagedir = NULL;
+  if (t->status == THREAD_DYING)
+    palloc_free_page (t);
+  intr_set_level (old_level);
+
+  pagedir_destroy (pd);
+}
+
 /* Sets up the CPU for running user code in the current
    thread.
    This function is called on every context switch. */
@@ -207,8 +428,12 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables.  A thread with no user
+     address space only touches kernel memory, which every page
+     directory maps the same way, so it keeps whichever page
+     directory is loaded and saves a TLB flush. */
+  if (t->pagedir != NULL && !t->exited)
+    pagedir_activate (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
@@ -305,9 +530,19 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL && process_reap_pending ())
+    t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) {
     goto done;
   }
+#ifdef VM
+  /* Without a page table there is no address space to reap. */
+  if (!page_table_init ()) {
+    pagedir_destroy (t->pagedir);
+    t->pagedir = NULL;
+    goto done;
+  }
+#endif
   process_activate ();
 
   // Yige, Pengdi, Peijie, Wei Po driving
@@ -448,7 +683,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* * Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -521,6 +758,32 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (ofs % PGSIZE == 0);
 
 
+#ifdef VM
+  while (read_bytes > 0 || zero_bytes > 0)
+    {
+      /* Record where this page comes from; it is read in on the
+         first page fault. */
+      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+      size_t page_zero_bytes = PGSIZE - page_read_bytes;
+      struct page *p = page_alloc (upage, writable);
+      if (p == NULL)
+        return false;
+      if (page_read_bytes > 0)
+        {
+          p->type = PAGE_FILE;
+          p->file = file;
+          p->file_ofs = ofs;
+          p->read_bytes = page_read_bytes;
+        }
+
+      /* Advance. */
+      read_bytes -= page_read_bytes;
+      zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
+      upage += PGSIZE;
+    }
+  return true;
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0)
     {
@@ -557,6 +820,28 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       upage += PGSIZE;
     }
   return true;
+#endif
+}
+
+/* Maps a zeroed page at the top of user virtual memory for the
+   initial stack.  Returns true if successful. */
+static bool
+map_stack_page (void)
+{
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+#ifdef VM
+  struct page *p = page_alloc (upage, true);
+  return p != NULL && page_in (p);
+#else
+  uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (kpage == NULL)
+    return false;
+  if (!install_page (upage, kpage, true)) {
+    palloc_free_page (kpage);
+    return false;
+  }
+  return true;
+#endif
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -564,7 +849,6 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp, int argc, char **argv)
 {
-  uint8_t *kpage;
   bool success = false;
   int i;                    /* Index */
   char *argv_addr[argc];    /* The address of each argument on stack */
@@ -577,80 +861,75 @@ setup_stack (void **esp, int argc, char **argv)
   int *int_esp = NULL;            /* Stack pointer to an integer pointer */
   void **fake_ptr_esp = NULL;     /* Stack pointer to fake return address */
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL)
-  {
-    success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-    if (success) {
-      *esp = PHYS_BASE;
-
-      /* Argument Passing */
-      /* Push argv onto the stack in reverse order */
-      char_esp = (char *) *esp;
-      for (i = argc - 1; i >= 0; i--) {
-        char_esp -= (strlen(argv[i]) + 1);    // Decrement pointer
-        strlcpy(char_esp, argv[i], strlen(argv[i]) + 1);   // copy argument
-        argv_addr[i] = char_esp;        // Save argument's address on stack
-      }
+  success = map_stack_page ();
+  if (success) {
+    *esp = PHYS_BASE;
+
+    /* Argument Passing */
+    /* Push argv onto the stack in reverse order */
+    char_esp = (char *) *esp;
+    for (i = argc - 1; i >= 0; i--) {
+      char_esp -= (strlen(argv[i]) + 1);    // Decrement pointer
+      strlcpy(char_esp, argv[i], strlen(argv[i]) + 1);   // copy argument
+      argv_addr[i] = char_esp;        // Save argument's address on stack
+    }
 
-      *esp = char_esp;      // Update stack pointer
+    *esp = char_esp;      // Update stack pointer
 
-      /* Word align addresses */
-      align_esp = (uint8_t *) *esp;
-      word_align = 0;
+    /* Word align addresses */
+    align_esp = (uint8_t *) *esp;
+    word_align = 0;
 
-      while ((uint32_t)align_esp & 0x3) {
-        // Address is not a multiple of 4
-        align_esp--;
-        *align_esp = word_align;      // Write the number to stack
-      }
+    while ((uint32_t)align_esp & 0x3) {
+      // Address is not a multiple of 4
+      align_esp--;
+      *align_esp = word_align;      // Write the number to stack
+    }
 
-      *esp = align_esp;               // Update stack pointer
+    *esp = align_esp;               // Update stack pointer
 
-      /* Push arguments' addresses on stack to the stack in reverse order. */
-      char_ptr_esp = (char **) *esp;
+    /* Push arguments' addresses on stack to the stack in reverse order. */
+    char_ptr_esp = (char **) *esp;
 
-      // Write address 0 indicating end of arguments
-      char_ptr_esp--;
-      *char_ptr_esp = (char *) 0;
+    // Write address 0 indicating end of arguments
+    char_ptr_esp--;
+    *char_ptr_esp = (char *) 0;
 
-      for (i = argc - 1; i >= 0; i--) {
-        char_ptr_esp--;
-        *char_ptr_esp = argv_addr[i];     // Write the address to stack
-      }
+    for (i = argc - 1; i >= 0; i--) {
+      char_ptr_esp--;
+      *char_ptr_esp = argv_addr[i];     // Write the address to stack
+    }
 
-      *esp = char_ptr_esp;                // Update stack pointer
+    *esp = char_ptr_esp;                // Update stack pointer
 
-      /* Push argv (the address of argv[0]) onto the stack */
-      argv_esp = char_ptr_esp;        // Save the address for argv[0]
-      argv_ptr_esp = (char ***) *esp;
+    /* Push argv (the address of argv[0]) onto the stack */
+    argv_esp = char_ptr_esp;        // Save the address for argv[0]
+    argv_ptr_esp = (char ***) *esp;
 
-      argv_ptr_esp--;
-      *argv_ptr_esp = argv_esp;   // Write the address for argv[0]
+    argv_ptr_esp--;
+    *argv_ptr_esp = argv_esp;   // Write the address for argv[0]
 
-      *esp = argv_ptr_esp;        // Update stack pointer
+    *esp = argv_ptr_esp;        // Update stack pointer
 
-      /* Push argc onto the stack */
-      int_esp = (int *) *esp;
-      int_esp--;
-      *int_esp = argc;        // Write argc
+    /* Push argc onto the stack */
+    int_esp = (int *) *esp;
+    int_esp--;
+    *int_esp = argc;        // Write argc
 
-      *esp = int_esp;         // Update stack pointer
+    *esp = int_esp;         // Update stack pointer
 
-      /* Push fake return address onto the stack */
-      fake_ptr_esp = (void **) *esp;
-      fake_ptr_esp--;
-      *fake_ptr_esp = (void *) 0;     /* Write fake return address 0 */
+    /* Push fake return address onto the stack */
+    fake_ptr_esp = (void **) *esp;
+    fake_ptr_esp--;
+    *fake_ptr_esp = (void *) 0;     /* Write fake return address 0 */
 
-      *esp = fake_ptr_esp;    // Update stack pointer
-    }  else {
-      palloc_free_page (kpage);
-    }
+    *esp = fake_ptr_esp;    // Update stack pointer
   }
 
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -670,3 +949,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
@@ -1,11 +1,16 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include "threads/interrupt.h"
 #include "threads/thread.h"
 
+void process_init (void);
 tid_t process_execute (const char *file_name);
+tid_t process_fork (struct intr_frame *);
 int process_wait (tid_t);
 void process_exit (void);
+bool process_reaped (struct thread *);
+bool process_reap_pending (void);
 void process_activate (void);
 
 #endif /* userprog/process.h */
@@ -5,20 +5,24 @@
 * kernel functionality, it invokes a system call.
 */
 #include "userprog/syscall.h"
-#include "userprog/pagedir.h"
 #include "userprog/process.h"
+#include "userprog/uaccess.h"
 #include <stdio.h>
 #include <syscall-nr.h>
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
-#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "devices/shutdown.h"
+#ifdef VM
+#include "vm/mmap.h"
+#endif
 
 static void syscall_handler (struct intr_frame *);
 static void halt (void);
@@ -39,19 +43,55 @@ static bool mkdir (const char *dir);
 static bool readdir (int fd, char *name);
 static bool isdir (int fd);
 static int inumber (int fd);
+static pid_t fork_process (struct intr_frame *f);
+#ifdef VM
+static mapid_t mmap (int fd, void *addr);
+static void munmap (mapid_t mapping);
+#endif
+
+/* Cache of struct file_info, one per open file descriptor. */
+static struct kmem_cache file_info_cache;
+
+/* Returns argument N of the system call whose arguments are on
+* the user stack at ESP, counting the system call number as argument 0.
+* If the argument is not in user memory, terminate the process.
+*/
+static uint32_t
+get_arg(const uint32_t *esp, int n) {
+  uint32_t arg;
+  if (!copy_from_user(&arg, esp + n, sizeof arg)) {
+    exit(-1);
+  }
+  return arg;
+}
 
-/* Checks stack pointer
-* If the user provides an invalid pointer, a pointer into kernel memory,
-* or a block partially in one of those regions, terminate the process.
+/* Copies the null-terminated string at user address USTR into a new
+* page, which the caller frees with palloc_free_page(). Strings longer
+* than a page are truncated. If the string is not in user memory,
+* terminate the process. Since exit() does not return, callers fetch
+* every other argument before the string.
+*/
+static char *
+get_string(const char *ustr) {
+  char *kstr = palloc_get_page(0);
+  if (kstr == NULL) {
+    exit(-1);
+  }
+  if (strncpy_from_user(kstr, ustr, PGSIZE) < 0) {
+    palloc_free_page(kstr);
+    exit(-1);
+  }
+  kstr[PGSIZE - 1] = '\0';
+  return kstr;
+}
+
+/* Terminates the process if the SIZE bytes of user buffer at BUFFER
+* reach into kernel memory. Unmapped pages are found while copying.
 */
-// Yige driving
 static void
-check_esp(void *esp) {
-  if (esp == NULL || !is_user_vaddr(esp) ||
-      pagedir_get_page (thread_current()->pagedir, esp) == NULL) {
-    printf("%s: exit(%d)\n", thread_name(), -1);
-    thread_current()->exit_status = -1;
-    thread_exit ();
+check_buffer(const void *buffer, unsigned size) {
+  if (!is_user_range(buffer, size)) {
+    exit(-1);
   }
 }
 
@@ -77,114 +117,116 @@ void
 syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+  kmem_cache_init (&file_info_cache, "file_info", sizeof (struct file_info),
+                   NULL);
 }
 
 // Pengdi driving
 static void
 syscall_handler (struct intr_frame *f)
 {
-  check_esp((void *)(f->esp));    /* Checks the pointer to syscall number. */
-  uint32_t *esp = (uint32_t *)f->esp;
+  const uint32_t *esp = (const uint32_t *)f->esp;
+  char *str = NULL;               /* Kernel copy of a string argument. */
 
-  switch (*esp) {
+#ifdef VM
+  /* Saved for stack growth on page faults inside system calls. */
+  thread_current()->user_esp = f->esp;
+#endif
+
+  switch (get_arg(esp, 0)) {
     // Processs Control
     case SYS_HALT:
       halt();
       break;
     case SYS_EXIT:
-      /* Checks the pointer to argument of syscall. */
-      check_esp((void *)(esp + 1));
-      exit((int)*(esp + 1));
+      exit((int)get_arg(esp, 1));
       break;
     case SYS_EXEC:
-      check_esp((void *)(esp + 1));
-      /* Checks the argument(pointer) of syscall. */
-      check_esp((void *)*(esp + 1));
+      str = get_string((const char *)get_arg(esp, 1));
       /* Stores the returned value to eax. */
-      f->eax = exec((const char *)*(esp + 1));
+      f->eax = exec(str);
       break;
     case SYS_WAIT:
-      check_esp((void *)(esp + 1));
-      f->eax = wait((pid_t)*(esp + 1));
+      f->eax = wait((pid_t)get_arg(esp, 1));
       break;
     // File System
-    case SYS_CREATE:
-      check_esp((void *)(esp + 1));
-      check_esp((void *)*(esp + 1));
-      check_esp((void *)(esp + 2));
-      f->eax = create((const char *)*(esp + 1), (unsigned)*(esp + 2));
+    case SYS_CREATE: {
+      /* Scalar arguments come first: a bad one exits without
+         freeing STR. */
+      unsigned initial_size = (unsigned)get_arg(esp, 2);
+      str = get_string((const char *)get_arg(esp, 1));
+      f->eax = create(str, initial_size);
       break;
+    }
     case SYS_REMOVE:
-      check_esp((void *)(esp + 1));
-      check_esp((void *)*(esp + 1));
-      f->eax = remove((const char *)*(esp + 1));
+      str = get_string((const char *)get_arg(esp, 1));
+      f->eax = remove(str);
       break;
     case SYS_OPEN:
-      check_esp((void *)(esp + 1));
-      check_esp((void *)*(esp + 1));
-      f->eax = open((const char *)*(esp + 1));
+      str = get_string((const char *)get_arg(esp, 1));
+      f->eax = open(str);
       break;
     case SYS_FILESIZE:
-      check_esp((void *)(esp + 1));
-      f->eax = filesize((int)*(esp + 1));
+      f->eax = filesize((int)get_arg(esp, 1));
       break;
     case SYS_READ:
-      check_esp((void *)(esp + 1));
-      check_esp((void *)(esp + 2));
-      check_esp((void *)*(esp + 2));
-      check_esp((void *)(esp + 3));
-      f->eax = read((int)*(esp + 1), (void *)*(esp + 2),
-                    (unsigned)*(esp + 3));
+      check_buffer((void *)get_arg(esp, 2), (unsigned)get_arg(esp, 3));
+      f->eax = read((int)get_arg(esp, 1), (void *)get_arg(esp, 2),
+                    (unsigned)get_arg(esp, 3));
       break;
     case SYS_WRITE:
-      check_esp((void *)(esp + 1));
-      check_esp((void *)(esp + 2));
-      check_esp((void *)*(esp + 2));
-      check_esp((void *)(esp + 3));
-      f->eax = write((int)*(esp + 1), (const void *)*(esp + 2),
-                     (unsigned)*(esp + 3));
+      check_buffer((void *)get_arg(esp, 2), (unsigned)get_arg(esp, 3));
+      f->eax = write((int)get_arg(esp, 1), (const void *)get_arg(esp, 2),
+                     (unsigned)get_arg(esp, 3));
       break;
     case SYS_SEEK:
-      check_esp((void *)(esp + 1));
-      check_esp((void *)(esp + 2));
-      seek((int)*(esp + 1), (unsigned)*(esp + 2));
+      seek((int)get_arg(esp, 1), (unsigned)get_arg(esp, 2));
       break;
     case SYS_TELL:
-      check_esp((void *)(esp + 1));
-      f->eax = tell((int)*(esp + 1));
+      f->eax = tell((int)get_arg(esp, 1));
       break;
     case SYS_CLOSE:
-      check_esp((void *)(esp + 1));
-      close((int)*(esp + 1));
+      close((int)get_arg(esp, 1));
       break;
     // Directory
     case SYS_CHDIR:
-      check_esp((void *)(esp + 1));
-      check_esp((void *)*(esp + 1));
-      f->eax = chdir((const char *)*(esp + 1));
+      str = get_string((const char *)get_arg(esp, 1));
+      f->eax = chdir(str);
       break;
     case SYS_MKDIR:
-      check_esp((void *)(esp + 1));
-      check_esp((void *)*(esp + 1));
-      f->eax = mkdir((const char *)*(esp + 1));
+      str = get_string((const char *)get_arg(esp, 1));
+      f->eax = mkdir(str);
       break;
     case SYS_READDIR:
-      check_esp((void *)(esp + 1));
-      check_esp((void *)(esp + 2));
-      check_esp((void *)*(esp + 2));
-      f->eax = readdir((int)*(esp + 1), (const void *)*(esp + 2));
+      check_buffer((void *)get_arg(esp, 2), NAME_MAX + 1);
+      f->eax = readdir((int)get_arg(esp, 1), (char *)get_arg(esp, 2));
       break;
     case SYS_ISDIR:
-      check_esp((void *)(esp + 1));
-      f->eax = isdir((int)*(esp + 1));
+      f->eax = isdir((int)get_arg(esp, 1));
       break;
     case SYS_INUMBER:
-      check_esp((void *)(esp + 1));
-      f->eax = inumber((int)*(esp + 1));
+      f->eax = inumber((int)get_arg(esp, 1));
       break;
+    // Extensions
+    case SYS_FORK:
+      f->eax = fork_process(f);
+      break;
+#ifdef VM
+    // Memory Mapping
+    case SYS_MMAP:
+      f->eax = mmap((int)get_arg(esp, 1), (void *)get_arg(esp, 2));
+      break;
+    case SYS_MUNMAP:
+      munmap((mapid_t)get_arg(esp, 1));
+      break;
+#endif
     default:
       printf("System Call not implemented.\n");
   }
+
+  if (str != NULL) {
+    palloc_free_page(str);
+  }
 }
 
 /* Terminates Pintos by calling shutdown_power_off().
@@ -232,27 +274,57 @@ wait (pid_t pid) {
 // Wei Po driving
 int
 write (int fd, const void *buffer, unsigned size) {
-      if (fd == 1) {
-    /* Writes to standard output. */
-    putbuf (buffer, size);
-        return size;
-  } else if (fd != 0){
+  const uint8_t *ubuf = buffer;   /* Remaining user data. */
+  struct file *cur = NULL;        /* File to write, NULL for console. */
+  int result = 0;                 /* Bytes written so far. */
+
+  if (fd == 0) {
+    /* Never writes to standard input. */
+    exit(-1);
+  } else if (fd != 1) {
     /* Writes to open file fd. */
     struct file_info *cur_info = get_file(fd);
     if (cur_info == NULL) {
       /* No such open file fd for current process. */
-            exit(-1);
+      exit(-1);
     }
-    struct file *cur = cur_info->file_temp;
+    cur = cur_info->file_temp;
     /* Cannot write to directory. */
     if (inode_isdir(file_get_inode(cur))) {
-            return -1;
+      return -1;
     }
-    int result = file_write (cur, buffer, size);
-        return result;
-  } else {  /* Never writes to standard input. */
-    exit(-1);
   }
+
+  /* Copy in a page at a time, so that no lock is held while user
+     memory is touched. */
+  uint8_t *bounce = palloc_get_page(0);
+  if (bounce == NULL) {
+    return -1;
+  }
+  while (size > 0) {
+    unsigned chunk = size < PGSIZE ? size : PGSIZE;
+    int written;
+
+    if (!copy_from_user(bounce, ubuf, chunk)) {
+      palloc_free_page(bounce);
+      exit(-1);
+    }
+    if (cur == NULL) {
+      /* Writes to standard output. */
+      putbuf((const char *)bounce, chunk);
+      written = chunk;
+    } else {
+      written = file_write(cur, bounce, chunk);
+    }
+    result += written;
+    ubuf += written;
+    size -= written;
+    if ((unsigned)written < chunk) {
+      break;
+    }
+  }
+  palloc_free_page(bounce);
+  return result;
 }
 
 /* Creates a new file called file initially initial_size bytes in size.
@@ -289,9 +361,9 @@ open (const char *file){
     /* No file named NAME exists, or an internal memory allocation fails. */
         return -1;
   }
-  struct file_info *cur_info = malloc(sizeof(struct file_info));
+  struct file_info *cur_info = kmem_cache_alloc (&file_info_cache);
   if (cur_info == NULL) {
-    /* Malloc failed. */
+    /* Allocation failed. */
         return -1;
   }
   cur_info->file_temp = cur;
@@ -333,6 +405,9 @@ filesize (int fd) {
 */
 int
 read (int fd, void *buffer, unsigned size) {
+  uint8_t *ubuf = buffer;         /* Remaining user buffer. */
+  int result = 0;                 /* Bytes read so far. */
+
      struct file_info *cur_info = get_file(fd);
   if (cur_info == NULL) {
     /* No such open file fd for current process. */
@@ -340,8 +415,30 @@ read (int fd, void *buffer, unsigned size) {
   }
 
   struct file *cur = cur_info->file_temp;
-  int result = file_read (cur, buffer, size);
-    return result;
+
+  /* Read a page at a time and copy out, so that no lock is held
+     while user memory is touched. */
+  uint8_t *bounce = palloc_get_page(0);
+  if (bounce == NULL) {
+    return -1;
+  }
+  while (size > 0) {
+    unsigned chunk = size < PGSIZE ? size : PGSIZE;
+    int bytes = file_read (cur, bounce, chunk);
+
+    if (!copy_to_user(ubuf, bounce, bytes)) {
+      palloc_free_page(bounce);
+      exit(-1);
+    }
+    result += bytes;
+    ubuf += bytes;
+    size -= bytes;
+    if ((unsigned)bytes < chunk) {
+      break;
+    }
+  }
+  palloc_free_page(bounce);
+  return result;
 }
 
 /* Changes the next byte to be read or written in open file fd to position,
@@ -396,16 +493,64 @@ close (int fd) {
     dir_close(cur_info->dir_temp);
   }
 
-  free(cur_info);     /* Frees memory allocated. */
+  kmem_cache_free (&file_info_cache, cur_info); /* Frees memory allocated. */
   }
 
-/* Closes open file file.
-* Used when exiting or terminating a process implicitly.
-*/
+/* Closes every open file of thread T and frees its file
+   information.  Used when exiting or terminating a process
+   implicitly. */
 void
-close_file (struct file *file) {
-      file_close (file);
-  }
+close_all_files (struct thread *t)
+{
+  while (!list_empty (&t->file_list))
+    {
+      struct file_info *f_i = list_entry (list_pop_front (&t->file_list),
+                                          struct file_info, file_elem);
+      file_close (f_i->file_temp);
+      if (f_i->dir_temp != NULL)
+        dir_close ((struct dir *) f_i->dir_temp);
+      kmem_cache_free (&file_info_cache, f_i);
+    }
+}
+
+/* Gives the current thread its own handle on each of PARENT's
+   open files, with the same descriptor and position.  Returns
+   false if memory allocation fails. */
+bool
+copy_files (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&parent->file_list); e != list_end (&parent->file_list);
+       e = list_next (e))
+    {
+      struct file_info *p_i = list_entry (e, struct file_info, file_elem);
+      struct file_info *c_i = kmem_cache_alloc (&file_info_cache);
+      struct inode *inode;
+
+      if (c_i == NULL)
+        return false;
+      c_i->file_temp = file_reopen (p_i->file_temp);
+      if (c_i->file_temp == NULL)
+        {
+          kmem_cache_free (&file_info_cache, c_i);
+          return false;
+        }
+      file_seek (c_i->file_temp, file_tell (p_i->file_temp));
+
+      inode = file_get_inode (c_i->file_temp);
+      if (p_i->dir_temp != NULL)
+        c_i->dir_temp = (struct file *) dir_open (inode_reopen (inode));
+      else
+        c_i->dir_temp = NULL;
+
+      c_i->fd = p_i->fd;
+      list_push_back (&cur->file_list, &c_i->file_elem);
+    }
+  cur->fd = parent->fd;
+  return true;
+}
 
 /* Changes the current working directory of the process to dir,
 which may be relative or absolute.
@@ -433,12 +578,13 @@ mkdir (const char *dir) {
 /* Reads a directory entry from file descriptor fd,
 which must represent a directory. If successful,
 stores the null-terminated file name in name,
-which must have room for READDIR_MAX_LEN + 1 bytes, and returns true.
+which must have room for NAME_MAX + 1 bytes, and returns true.
 If no entries are left in the directory, returns false.
 */
 // Yige Driving
 bool
-readdir (int fd, char *name) {
+readdir (int fd, char *uname) {
+  char name[NAME_MAX + 1] = "";   /* Kernel copy of the name. */
      struct file_info *cur_info = get_file(fd);
   if (cur_info == NULL) {
     /* No such open file fd for current process. */
@@ -466,6 +612,9 @@ readdir (int fd, char *name) {
     result = dir_readdir(cur_info->dir_temp, name);
   }
 
+  if (result && !copy_to_user(uname, name, strlen(name) + 1)) {
+    exit(-1);
+  }
   return result;
 }
 
@@ -506,3 +655,41 @@ inumber (int fd) {
 
   return result;
 }
+
+/* Creates a copy of the current process. Returns the child's pid
+in the parent and 0 in the child, or -1 if the copy fails.
+*/
+pid_t
+fork_process (struct intr_frame *f) {
+  tid_t tid = process_fork(f);
+  return tid == TID_ERROR ? -1 : tid;
+}
+
+#ifdef VM
+/* Maps the file open as fd into the process's virtual address space
+starting at addr. Returns the mapping id, or -1 if the file cannot
+be mapped there.
+*/
+mapid_t
+mmap (int fd, void *addr) {
+  struct file_info *cur_info = get_file(fd);
+  if (cur_info == NULL) {
+    /* No such open file fd, including the console. */
+    return MAP_FAILED;
+  }
+  if (cur_info->dir_temp != NULL) {
+    /* Directories cannot be mapped. */
+    return MAP_FAILED;
+  }
+
+  return mmap_map(cur_info->file_temp, addr);
+}
+
+/* Unmaps the mapping designated by mapping, writing back
+modified pages to the file.
+*/
+void
+munmap (mapid_t mapping) {
+  mmap_unmap(mapping);
+}
+#endif
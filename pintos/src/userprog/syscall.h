@@ -1,11 +1,15 @@
 #include <list.h>
+#include <stdbool.h>
 #include "filesys/file.h"
 
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+struct thread;
+
 void syscall_init (void);
-void close_file (struct file *);
+bool copy_files (struct thread *parent);
+void close_all_files (struct thread *);
 
 struct file_info
 {
@@ -0,0 +1,141 @@
+/*
+* Description: Access to user memory from system calls.  User
+* pointers are not checked against the page tables before use.
+* Instead the copy routines touch user memory directly, and each
+* instruction that may fault on a bad user address has an entry
+* in the exception table naming fixup code to resume at.  When
+* the page fault handler cannot resolve a fault in the kernel, it
+* looks up the faulting instruction with uaccess_fixup(), and the
+* fixup makes the copy return failure.
+*/
+#include "userprog/uaccess.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+
+/* An exception table entry.  The linker script gathers the
+   entries emitted alongside each faulting instruction into one
+   table between _start_ex_table and _end_ex_table. */
+struct exception_entry
+{
+  uintptr_t insn;               /* Instruction that may fault. */
+  uintptr_t fixup;              /* Where to resume if it does. */
+};
+
+extern const struct exception_entry _start_ex_table[], _end_ex_table[];
+
+static size_t copy_user (void *dst, const void *src, size_t size);
+static inline bool get_user_byte (uint8_t *dst, const uint8_t *usrc);
+
+/* Copies SIZE bytes from user address USRC to KDST.  Returns
+   false if any part of the source is not valid user memory, in
+   which case part of KDST may have been written. */
+bool
+copy_from_user (void *kdst, const void *usrc, size_t size)
+{
+  return is_user_range (usrc, size) && copy_user (kdst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from KSRC to user address UDST.  Returns
+   false if any part of the destination is not valid, writable
+   user memory, in which case part of it may have been
+   written. */
+bool
+copy_to_user (void *udst, const void *ksrc, size_t size)
+{
+  return is_user_range (udst, size) && copy_user (udst, ksrc, size) == 0;
+}
+
+/* Copies the null-terminated string at user address USRC into
+   KDST, which has room for SIZE bytes.  Returns the length of the
+   string, not counting the null terminator.  If the string does
+   not fit, copies SIZE bytes and returns SIZE, leaving KDST
+   unterminated.  Returns -1 if the string is not valid user
+   memory. */
+int
+strncpy_from_user (char *kdst, const char *usrc, size_t size)
+{
+  const uint8_t *src = (const uint8_t *) usrc;
+  size_t i;
+
+  ASSERT (size <= INT32_MAX);
+
+  for (i = 0; i < size; i++)
+    {
+      if (!is_user_vaddr (src + i)
+          || !get_user_byte ((uint8_t *) kdst + i, src + i))
+        return -1;
+      if (kdst[i] == '\0')
+        return i;
+    }
+  return size;
+}
+
+/* Called by the page fault handler for a fault in the kernel
+   that could not be resolved.  If F's instruction is in the
+   exception table, makes F resume at its fixup and returns true;
+   otherwise returns false. */
+bool
+uaccess_fixup (struct intr_frame *f)
+{
+  const struct exception_entry *e;
+
+  for (e = _start_ex_table; e < _end_ex_table; e++)
+    if (e->insn == (uintptr_t) f->eip)
+      {
+        f->eip = (void (*) (void)) e->fixup;
+        return true;
+      }
+  return false;
+}
+
+/* Copies SIZE bytes from SRC to DST, a double word at a time
+   and then the remaining bytes.  Returns the number of bytes
+   left uncopied when a fault stopped the copy, or 0. */
+static size_t
+copy_user (void *dst, const void *src, size_t size)
+{
+  size_t left = size / 4;
+
+  /* A fault in the double word copy leaves ECX double words
+     and the tail still to go. */
+  asm volatile ("1: rep movsl\n"
+                "   movl %3, %0\n"
+                "2: rep movsb\n"
+                "3:\n"
+                ".section .fixup, \"ax\"\n"
+                "4: leal (%3,%0,4), %0\n"
+                "   jmp 3b\n"
+                ".previous\n"
+                ".section __ex_table, \"a\"\n"
+                "   .long 1b, 4b\n"
+                "   .long 2b, 3b\n"
+                ".previous"
+                : "+c" (left), "+S" (src), "+D" (dst)
+                : "r" (size % 4)
+                : "memory");
+  return left;
+}
+
+/* Reads the byte at user address USRC into *DST.  Returns false
+   if the read faulted. */
+static inline bool
+get_user_byte (uint8_t *dst, const uint8_t *usrc)
+{
+  bool ok;
+  uint8_t byte;
+
+  asm volatile ("   movb $1, %0\n"
+                "1: movb %2, %1\n"
+                "2:\n"
+                ".section .fixup, \"ax\"\n"
+                "3: movb $0, %0\n"
+                "   jmp 2b\n"
+                ".previous\n"
+                ".section __ex_table, \"a\"\n"
+                "   .long 1b, 3b\n"
+                ".previous"
+                : "=&q" (ok), "=q" (byte)
+                : "m" (*usrc));
+  *dst = byte;
+  return ok;
+}
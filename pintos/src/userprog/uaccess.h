@@ -0,0 +1,26 @@
+#ifndef USERPROG_UACCESS_H
+#define USERPROG_UACCESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/vaddr.h"
+
+struct intr_frame;
+
+/* Returns true if the SIZE bytes at UADDR lie entirely below
+   PHYS_BASE.  This is the only check made before touching user
+   memory: whether the pages are mapped is left to the MMU. */
+static inline bool
+is_user_range (const void *uaddr, size_t size)
+{
+  uintptr_t start = (uintptr_t) uaddr;
+  return start + size >= start && start + size <= (uintptr_t) PHYS_BASE;
+}
+
+bool copy_from_user (void *kdst, const void *usrc, size_t size);
+bool copy_to_user (void *udst, const void *ksrc, size_t size);
+int strncpy_from_user (char *kdst, const char *usrc, size_t size);
+bool uaccess_fixup (struct intr_frame *);
+
+#endif /* userprog/uaccess.h */
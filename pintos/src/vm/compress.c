@@ -0,0 +1,124 @@
+/*
+* Description: A small LZSS codec for the compressed swap cache.
+* It trades compression ratio for speed: one hash probe per
+* position and no lazy matching.
+*
+* Compressed data is a sequence of groups.  Each group starts
+* with a control byte whose bits, least significant first, say
+* whether each of the next eight items is a literal byte (0) or
+* a match (1).  A match is two bytes holding a 12-bit distance
+* back into the output and a 4-bit length.
+*/
+#include "vm/compress.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MIN_MATCH 3                     /* Shortest match encoded. */
+#define MAX_MATCH (MIN_MATCH + 15)      /* Longest match encoded. */
+#define MAX_DIST 4095                   /* Farthest match encoded. */
+
+/* Hash table of recent positions, each stored plus one so that
+   zero means empty.  Callers serialize calls to compress(). */
+#define HASH_BITS 10
+static uint16_t hash_table[1 << HASH_BITS];
+
+/* Returns a hash of the MIN_MATCH bytes at P. */
+static inline unsigned
+hash3 (const uint8_t *p)
+{
+  uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Compresses the SRC_SIZE bytes at SRC into DST, which has room
+   for DST_SIZE bytes.  Returns the compressed size, or 0 if the
+   data does not fit.  Not reentrant. */
+size_t
+compress (const void *src_, size_t src_size, void *dst_, size_t dst_size)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  size_t ip = 0, op = 0;
+
+  ASSERT (src_size < UINT16_MAX);
+
+  memset (hash_table, 0, sizeof hash_table);
+  while (ip < src_size)
+    {
+      size_t ctrl_ofs;
+      int bit;
+
+      /* Room for a control byte and eight matches. */
+      if (op + 1 + 8 * 2 > dst_size)
+        return 0;
+      ctrl_ofs = op++;
+      dst[ctrl_ofs] = 0;
+
+      for (bit = 0; bit < 8 && ip < src_size; bit++)
+        {
+          if (ip + MIN_MATCH <= src_size)
+            {
+              unsigned h = hash3 (src + ip);
+              size_t cand = hash_table[h];
+
+              hash_table[h] = ip + 1;
+              if (cand != 0 && ip - (cand - 1) <= MAX_DIST
+                  && !memcmp (src + cand - 1, src + ip, MIN_MATCH))
+                {
+                  size_t dist = ip - (cand - 1);
+                  size_t len = MIN_MATCH;
+
+                  while (len < MAX_MATCH && ip + len < src_size
+                         && src[ip + len] == src[ip + len - dist])
+                    len++;
+
+                  dst[ctrl_ofs] |= 1 << bit;
+                  dst[op++] = dist & 0xff;
+                  dst[op++] = ((dist >> 8) << 4) | (len - MIN_MATCH);
+                  ip += len;
+                  continue;
+                }
+            }
+          dst[op++] = src[ip++];
+        }
+    }
+  return op;
+}
+
+/* Decompresses the SRC_SIZE bytes at SRC, produced by
+   compress(), into the DST_SIZE bytes at DST. */
+void
+decompress (const void *src_, size_t src_size, void *dst_, size_t dst_size)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  size_t ip = 0, op = 0;
+
+  while (ip < src_size)
+    {
+      uint8_t ctrl = src[ip++];
+      int bit;
+
+      for (bit = 0; bit < 8 && ip < src_size; bit++)
+        if (ctrl & (1 << bit))
+          {
+            size_t dist = src[ip] | ((src[ip + 1] >> 4) << 8);
+            size_t len = (src[ip + 1] & 0xf) + MIN_MATCH;
+
+            ip += 2;
+            ASSERT (dist > 0 && dist <= op && op + len <= dst_size);
+
+            /* Copy a byte at a time: the source may overlap the
+               bytes being written. */
+            for (; len > 0; len--, op++)
+              dst[op] = dst[op - dist];
+          }
+        else
+          {
+            ASSERT (op < dst_size);
+            dst[op++] = src[ip++];
+          }
+    }
+  ASSERT (op == dst_size);
+}
@@ -0,0 +1,11 @@
+#ifndef VM_COMPRESS_H
+#define VM_COMPRESS_H
+
+#include <stddef.h>
+
+size_t compress (const void *src, size_t src_size,
+                 void *dst, size_t dst_size);
+void decompress (const void *src, size_t src_size,
+                 void *dst, size_t dst_size);
+
+#endif /* vm/compress.h */
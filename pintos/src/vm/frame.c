@@ -0,0 +1,626 @@
+/*
+* Description: Frame table.  Tracks every user pool page that
+* holds a user page and chooses eviction victims with the clock
+* algorithm when the user pool runs out.  Frames holding file
+* data form the page cache, indexed by inode and offset, through
+* which the file system, memory mappings, and executables all
+* reach file data.
+*/
+#include "vm/frame.h"
+#include <debug.h>
+#include <string.h>
+#include "vm/page.h"
+#include "filesys/inode.h"
+#include "threads/slab.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+#include "vm/swap.h"
+
+/* List of all frames holding user pages. */
+static struct list frame_table;
+
+/* Frame of zeros mapped read-only by zero-fill pages that have
+   only been read.  It is not in frame_table, so it is never
+   evicted, and it holds a pin of its own so it is never freed. */
+static struct frame zero_frame;
+
+/* Page cache: frames holding file data, keyed by inode and
+   offset. */
+static struct hash page_cache;
+
+/* Protects frame_table, page_cache, clock_hand, and the page
+   lists, pin counts, cache keys, and evicting flags of frames. */
+static struct lock frame_lock;
+
+/* A frame being written out is off frame_table and marked
+   evicting, but its pages and cache entry still lead to it, so
+   that nobody reads the data from disk before it gets there.
+   Whoever reaches it that way waits here, with FRAME_LOCK, until
+   it has been written. */
+static struct condition evict_done;
+
+/* Next frame to be examined by the clock algorithm. */
+static struct list_elem *clock_hand;
+
+/* Evictions since the last frame_sample(). */
+static size_t evict_cnt;
+
+/* Slab cache of struct frame.  (frame_cache_*() name the page
+   cache.) */
+static struct kmem_cache frame_slab;
+
+static struct frame *frame_evict (void);
+static struct frame *frame_clock (bool local);
+static bool frame_is_local (struct frame *);
+static struct frame *cache_get (struct inode *, off_t file_ofs, bool fill,
+                                bool may_evict);
+static struct frame *cache_lookup (struct frame *key);
+static void cache_write_back (struct frame *);
+static void frame_uncache (struct frame *);
+static hash_hash_func frame_hash;
+static hash_less_func frame_less;
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frame_table);
+  if (!hash_init (&page_cache, frame_hash, frame_less, NULL))
+    PANIC ("page cache creation failed");
+  lock_init (&frame_lock);
+  cond_init (&evict_done);
+  clock_hand = NULL;
+  kmem_cache_init (&frame_slab, "frame", sizeof (struct frame), NULL);
+
+  zero_frame.kpage = palloc_get_page (PAL_ZERO);
+  if (zero_frame.kpage == NULL)
+    PANIC ("zero frame allocation failed");
+  list_init (&zero_frame.pages);
+  zero_frame.pin_cnt = 1;
+  zero_frame.evicting = false;
+  zero_frame.inode = NULL;
+}
+
+/* Obtains a frame, reaping exited processes and then evicting a
+   resident page if the user pool is exhausted.  If ZERO is true,
+   the frame is cleared, preferably by taking a page the idle
+   thread has already zeroed.  The frame is returned pinned and
+   with no pages; the caller fills it, adds its page with
+   frame_add_page(), and then unpins it.  Returns a null pointer
+   if no frame can be found. */
+struct frame *
+frame_alloc (bool zero)
+{
+  struct frame *f = frame_try_alloc (zero);
+
+  /* Exited processes may still hold frames the reaper has not got
+     to yet. */
+  if (f == NULL && process_reap_pending ())
+    f = frame_try_alloc (zero);
+  if (f == NULL)
+    {
+      /* User pool is full, reuse somebody else's frame. */
+      f = frame_evict ();
+      if (f != NULL && zero)
+        memset (f->kpage, 0, PGSIZE);
+    }
+  return f;
+}
+
+/* Like frame_alloc(), but returns a null pointer instead of
+   evicting a page when the user pool is exhausted. */
+struct frame *
+frame_try_alloc (bool zero)
+{
+  struct frame *f;
+  void *kpage;
+
+  kpage = palloc_get_page (PAL_USER | (zero ? PAL_ZERO : 0));
+  if (kpage == NULL)
+    return NULL;
+
+  f = kmem_cache_alloc (&frame_slab);
+  if (f == NULL)
+    {
+      palloc_free_page (kpage);
+      return NULL;
+    }
+  f->kpage = kpage;
+  list_init (&f->pages);
+  f->pin_cnt = 1;
+  f->evicting = false;
+  f->inode = NULL;
+  f->dirty = false;
+  f->accessed = false;
+
+  lock_acquire (&frame_lock);
+  list_push_back (&frame_table, &f->elem);
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Returns F, which must be pinned by the caller and have no
+   pages, to the user pool. */
+void
+frame_free (struct frame *f)
+{
+  ASSERT (list_empty (&f->pages));
+  ASSERT (f != &zero_frame);
+
+  lock_acquire (&frame_lock);
+  frame_uncache (f);
+  if (clock_hand == &f->elem)
+    clock_hand = list_next (clock_hand);
+  list_remove (&f->elem);
+  lock_release (&frame_lock);
+
+  palloc_free_page (f->kpage);
+  kmem_cache_free (&frame_slab, f);
+}
+
+/* Records that PAGE is mapped to frame F. */
+void
+frame_add_page (struct frame *f, struct page *page)
+{
+  lock_acquire (&frame_lock);
+  list_push_back (&f->pages, &page->frame_elem);
+  page->frame = f;
+  if (f != &zero_frame)
+    page->owner->frame_cnt++;
+  lock_release (&frame_lock);
+}
+
+/* Detaches PAGE from its frame, which the caller has pinned, and
+   drops that pin.  The frame is returned to the user pool once
+   no page maps it any more, unless it is in the page cache. */
+void
+frame_remove_page (struct page *page)
+{
+  struct frame *f = page->frame;
+  bool unused;
+
+  lock_acquire (&frame_lock);
+  list_remove (&page->frame_elem);
+  page->frame = NULL;
+  if (f != &zero_frame)
+    page->owner->frame_cnt--;
+  f->pin_cnt--;
+  unused = list_empty (&f->pages) && f != &zero_frame && f->inode == NULL;
+  if (unused)
+    {
+      ASSERT (f->pin_cnt == 0);
+      if (clock_hand == &f->elem)
+        clock_hand = list_next (clock_hand);
+      list_remove (&f->elem);
+    }
+  lock_release (&frame_lock);
+
+  if (unused)
+    {
+      palloc_free_page (f->kpage);
+      kmem_cache_free (&frame_slab, f);
+    }
+}
+
+/* Returns the number of pages sharing frame F. */
+size_t
+frame_share_cnt (struct frame *f)
+{
+  size_t cnt;
+
+  lock_acquire (&frame_lock);
+  cnt = list_size (&f->pages);
+  lock_release (&frame_lock);
+  return cnt;
+}
+
+/* Pins the frame holding PAGE, if there is one, so that it
+   cannot be evicted.  Waits for an eviction of PAGE already in
+   progress to finish.  Returns true if PAGE is resident. */
+bool
+frame_pin_page (struct page *page)
+{
+  bool resident;
+
+  lock_acquire (&frame_lock);
+  while (page->frame != NULL && page->frame->evicting)
+    cond_wait (&evict_done, &frame_lock);
+  resident = page->frame != NULL;
+  if (resident)
+    page->frame->pin_cnt++;
+  lock_release (&frame_lock);
+  return resident;
+}
+
+/* Drops one pin on F. */
+void
+frame_unpin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Pins and returns the shared frame of zeros.  The caller maps
+   it read-only, adds its page, and unpins it. */
+struct frame *
+frame_zero (void)
+{
+  lock_acquire (&frame_lock);
+  zero_frame.pin_cnt++;
+  lock_release (&frame_lock);
+  return &zero_frame;
+}
+
+/* Returns true if F is the shared frame of zeros, which must
+   never be written. */
+bool
+frame_is_zero (const struct frame *f)
+{
+  return f == &zero_frame;
+}
+
+/* Returns the page cache frame holding the page at FILE_OFS,
+   which must be page-aligned, in INODE, pinned.  If the page is
+   not cached, a frame is allocated for it and, if FILL is true,
+   read from INODE; if FILL is false, the caller is about to
+   overwrite the whole page, so it is only cleared.  Bytes past
+   the end of the file read as zeros.  The caller unpins the
+   frame when done with it.  Returns a null pointer if no frame
+   is available. */
+struct frame *
+frame_cache_get (struct inode *inode, off_t file_ofs, bool fill)
+{
+  return cache_get (inode, file_ofs, fill, true);
+}
+
+/* Like frame_cache_get() with FILL true, but for reading ahead:
+   returns a null pointer instead of evicting another page to
+   make room. */
+struct frame *
+frame_cache_try_get (struct inode *inode, off_t file_ofs)
+{
+  return cache_get (inode, file_ofs, true, false);
+}
+
+/* Returns true if F is in the page cache, so that writes to it
+   are writes to a file. */
+bool
+frame_is_cache (const struct frame *f)
+{
+  return f->inode != NULL;
+}
+
+/* Marks page cache frame F as modified, so that it is written
+   back to its file before it is reused.  The caller must have F
+   pinned, or be evicting it. */
+void
+frame_set_dirty (struct frame *f)
+{
+  ASSERT (f->inode != NULL);
+
+  f->dirty = true;
+}
+
+/* Removes INODE's pages from the page cache, writing modified
+   ones back first if WRITE_BACK is true.  Called when INODE is
+   closed for the last time, after which no page maps them.  Each
+   page is taken off the clock and written without FRAME_LOCK,
+   the way frame_evict() does. */
+void
+frame_cache_drop (struct inode *inode, bool write_back)
+{
+  struct list *frames = inode_frames (inode);
+
+  lock_acquire (&frame_lock);
+  while (!list_empty (frames))
+    {
+      struct frame *f = list_entry (list_front (frames), struct frame,
+                                    inode_elem);
+
+      /* A frame already being evicted is written back and
+         uncached by its evictor. */
+      if (f->evicting)
+        {
+          cond_wait (&evict_done, &frame_lock);
+          continue;
+        }
+
+      ASSERT (list_empty (&f->pages) && f->pin_cnt == 0);
+      if (clock_hand == &f->elem)
+        clock_hand = list_next (clock_hand);
+      list_remove (&f->elem);
+      f->pin_cnt = 1;
+      f->evicting = true;
+      lock_release (&frame_lock);
+
+      if (write_back)
+        cache_write_back (f);
+
+      lock_acquire (&frame_lock);
+      frame_uncache (f);
+      cond_broadcast (&evict_done, &frame_lock);
+      palloc_free_page (f->kpage);
+      kmem_cache_free (&frame_slab, f);
+    }
+  lock_release (&frame_lock);
+}
+
+/* Writes every modified page in the page cache back to its
+   file, including pages written through memory mappings that
+   have not been unmapped, such as those of processes the reaper
+   has not got to yet. */
+void
+frame_cache_flush (void)
+{
+  struct list_elem *e;
+
+  lock_acquire (&frame_lock);
+  for (e = list_begin (&frame_table); e != list_end (&frame_table);
+       e = list_next (e))
+    {
+      struct frame *f = list_entry (e, struct frame, elem);
+      if (f->inode != NULL)
+        {
+          if (page_frame_dirty (f))
+            f->dirty = true;
+          cache_write_back (f);
+        }
+    }
+  lock_release (&frame_lock);
+}
+
+/* Samples the working sets of all processes: adds each resident
+   page accessed since the last call to its owner's wset_accum
+   and moves its accessed bit into its frame's.  Stores the
+   number of frames into *FRAME_CNT and the number of evictions
+   since the last call into *EVICTIONS. */
+void
+frame_sample (size_t *frame_cnt, size_t *evictions)
+{
+  struct list_elem *e;
+
+  lock_acquire (&frame_lock);
+  for (e = list_begin (&frame_table); e != list_end (&frame_table);
+       e = list_next (e))
+    page_frame_sample (list_entry (e, struct frame, elem));
+  *frame_cnt = list_size (&frame_table);
+  *evictions = evict_cnt;
+  evict_cnt = 0;
+  lock_release (&frame_lock);
+}
+
+/* Chooses a victim, writes its pages out, and returns the now
+   unused frame, pinned.  A process holding at least its frame
+   quota replaces one of its own pages, so that it cannot push
+   every other process out of memory; if it has none to give up,
+   or is under quota, the victim is chosen from all frames.  The
+   victim is written out without FRAME_LOCK, so that other
+   processes can keep faulting while it is.  Returns a null
+   pointer if every frame is pinned. */
+static struct frame *
+frame_evict (void)
+{
+  struct thread *cur = thread_current ();
+  struct frame *f = NULL;
+  struct list_elem *e;
+  swap_slot_t slot = SWAP_NONE;
+  bool swap;
+
+  lock_acquire (&frame_lock);
+  if (cur->frame_cnt >= cur->frame_quota)
+    f = frame_clock (true);
+  if (f == NULL)
+    f = frame_clock (false);
+  if (f == NULL)
+    {
+      lock_release (&frame_lock);
+      return NULL;
+    }
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    list_entry (e, struct page, frame_elem)->owner->frame_cnt--;
+  if (clock_hand == &f->elem)
+    clock_hand = list_next (clock_hand);
+  list_remove (&f->elem);
+  f->pin_cnt = 1;
+  f->evicting = true;
+  swap = page_evict (f);
+  lock_release (&frame_lock);
+
+  if (swap)
+    slot = swap_out (f->kpage);
+  else if (f->inode != NULL)
+    cache_write_back (f);
+
+  lock_acquire (&frame_lock);
+  page_evict_finish (f, slot);
+  frame_uncache (f);
+  f->evicting = false;
+  cond_broadcast (&evict_done, &frame_lock);
+  list_push_back (&frame_table, &f->elem);
+  evict_cnt++;
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Chooses a victim with the clock algorithm.  Frames accessed
+   since the hand last passed them, by a process or through the
+   page cache, get a second chance; so do frames whose accessed
+   bits the working set sampler moved into the frame.  If LOCAL
+   is true, only frames used by the current process alone are
+   considered.  Returns a null pointer if no frame can be
+   evicted.  FRAME_LOCK must be held. */
+static struct frame *
+frame_clock (bool local)
+{
+  size_t i, n;
+
+  /* Two full sweeps clear every accessed bit, so if nothing is
+     found by then everything is pinned. */
+  n = 2 * list_size (&frame_table) + 1;
+  for (i = 0; i < n; i++)
+    {
+      struct frame *f;
+      bool accessed;
+
+      if (clock_hand == NULL || clock_hand == list_end (&frame_table))
+        clock_hand = list_begin (&frame_table);
+      if (clock_hand == list_end (&frame_table))
+        return NULL;
+
+      f = list_entry (clock_hand, struct frame, elem);
+      clock_hand = list_next (clock_hand);
+
+      if (f->pin_cnt > 0 || (local && !frame_is_local (f)))
+        continue;
+      accessed = page_frame_accessed (f) || f->accessed;
+      f->accessed = false;
+      if (!accessed)
+        return f;
+    }
+  return NULL;
+}
+
+/* Returns true if F holds pages of the current process only.
+   FRAME_LOCK must be held. */
+static bool
+frame_is_local (struct frame *f)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (list_entry (e, struct page, frame_elem)->owner != cur)
+      return false;
+  return !list_empty (&f->pages);
+}
+
+/* Looks up or loads the page at FILE_OFS in INODE, as described
+   for frame_cache_get().  The disk is read without FRAME_LOCK;
+   if another thread caches the same page meanwhile, its frame
+   wins and ours is freed.  If that frame was being evicted, our
+   copy may predate its write-back, so we start over. */
+static struct frame *
+cache_get (struct inode *inode, off_t file_ofs, bool fill, bool may_evict)
+{
+  struct frame key;
+  struct frame *f, *cached;
+
+  ASSERT (inode != NULL);
+  ASSERT (pg_ofs ((void *) file_ofs) == 0);
+
+  key.inode = inode;
+  key.file_ofs = file_ofs;
+
+  for (;;)
+    {
+      lock_acquire (&frame_lock);
+      cached = cache_lookup (&key);
+      lock_release (&frame_lock);
+      if (cached != NULL)
+        return cached;
+
+      f = may_evict ? frame_alloc (!fill) : frame_try_alloc (!fill);
+      if (f == NULL)
+        return NULL;
+      if (fill)
+        inode_read_page (inode, file_ofs, f->kpage);
+
+      lock_acquire (&frame_lock);
+      if (hash_find (&page_cache, &key.cache_elem) == NULL)
+        {
+          f->inode = inode;
+          f->file_ofs = file_ofs;
+          f->accessed = true;
+          hash_insert (&page_cache, &f->cache_elem);
+          list_push_back (inode_frames (inode), &f->inode_elem);
+          lock_release (&frame_lock);
+          return f;
+        }
+      cached = cache_lookup (&key);
+      lock_release (&frame_lock);
+
+      frame_free (f);
+      if (cached != NULL)
+        return cached;
+    }
+}
+
+/* Returns the page cache frame at KEY's file position, pinned,
+   or a null pointer if the page is not cached.  Waits for an
+   eviction of the page in progress to finish first.  FRAME_LOCK
+   must be held. */
+static struct frame *
+cache_lookup (struct frame *key)
+{
+  struct hash_elem *e;
+
+  while ((e = hash_find (&page_cache, &key->cache_elem)) != NULL)
+    {
+      struct frame *f = hash_entry (e, struct frame, cache_elem);
+
+      if (!f->evicting)
+        {
+          f->pin_cnt++;
+          f->accessed = true;
+          return f;
+        }
+      cond_wait (&evict_done, &frame_lock);
+    }
+  return NULL;
+}
+
+/* Writes page cache frame F back to its file if it has been
+   modified.  FRAME_LOCK must be held, unless the caller is
+   evicting F. */
+static void
+cache_write_back (struct frame *f)
+{
+  if (f->dirty)
+    {
+      inode_write_page (f->inode, f->file_ofs, f->kpage);
+      f->dirty = false;
+    }
+}
+
+/* Removes F from the page cache, if it is there.  FRAME_LOCK
+   must be held. */
+static void
+frame_uncache (struct frame *f)
+{
+  if (f->inode != NULL)
+    {
+      hash_delete (&page_cache, &f->cache_elem);
+      list_remove (&f->inode_elem);
+      f->inode = NULL;
+      f->dirty = false;
+    }
+}
+
+/* Returns a hash value for frame F's file position. */
+static unsigned
+frame_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, cache_elem);
+  return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->file_ofs);
+}
+
+/* Returns true if frame A's file position precedes frame B's. */
+static bool
+frame_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, cache_elem);
+  const struct frame *b = hash_entry (b_, struct frame, cache_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  return a->file_ofs < b->file_ofs;
+}
@@ -0,0 +1,63 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct inode;
+struct page;
+
+/* A physical frame holding user data.  A frame is normally
+   mapped by a single page, but after fork() the pages of parent
+   and child share it copy-on-write until one of them writes, and
+   a frame holding read-only executable data is shared by every
+   process running that executable.  Zero-fill pages that have
+   only been read all share one frame of zeros.
+
+   A frame may also be a page of the page cache, holding one
+   page of a file's data.  The file system reads and writes file
+   data through these frames, and memory mappings and executable
+   pages map them directly, so there is only ever one copy of a
+   page of a file in memory.  A cache frame stays in the frame
+   table while no page maps it, until it is evicted or its file
+   is closed. */
+struct frame
+{
+  void *kpage;                  /* Kernel virtual address of the frame. */
+  struct list pages;            /* Pages mapped to this frame. */
+  int pin_cnt;                  /* Frame may not be evicted while > 0. */
+  bool accessed;                /* Used since the clock hand passed? */
+  bool evicting;                /* Being written out by frame_evict()? */
+  struct list_elem elem;        /* Element in frame table. */
+
+  /* Page cache. */
+  struct inode *inode;          /* File the data belongs to, or NULL. */
+  off_t file_ofs;               /* Page-aligned offset of the data. */
+  bool dirty;                   /* Modified since read from INODE? */
+  struct hash_elem cache_elem;  /* Element in page cache. */
+  struct list_elem inode_elem;  /* Element in INODE's frame list. */
+};
+
+void frame_init (void);
+struct frame *frame_alloc (bool zero);
+struct frame *frame_try_alloc (bool zero);
+void frame_free (struct frame *);
+void frame_add_page (struct frame *, struct page *);
+void frame_remove_page (struct page *);
+size_t frame_share_cnt (struct frame *);
+bool frame_pin_page (struct page *);
+void frame_unpin (struct frame *);
+struct frame *frame_zero (void);
+bool frame_is_zero (const struct frame *);
+struct frame *frame_cache_get (struct inode *, off_t file_ofs, bool fill);
+struct frame *frame_cache_try_get (struct inode *, off_t file_ofs);
+bool frame_is_cache (const struct frame *);
+void frame_set_dirty (struct frame *);
+void frame_cache_drop (struct inode *, bool write_back);
+void frame_cache_flush (void);
+void frame_sample (size_t *frame_cnt, size_t *evictions);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,148 @@
+/*
+* Description: Memory-mapped files.  Each mapping is a run of
+* PAGE_MMAP pages in the supplemental page table that are read
+* from the file on demand and written back when dirty.
+*/
+#include "vm/mmap.h"
+#include <debug.h>
+#include <round.h>
+#include "vm/page.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+static struct mapping *lookup_mapping (mapid_t);
+static void unmap (struct mapping *);
+
+/* Maps FILE into the current process's address space starting
+   at ADDR.  Returns the new mapping's identifier, or MAP_FAILED
+   if FILE is empty, ADDR is not page-aligned, or the mapping
+   would overlap pages already in use or the stack. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  off_t length;
+  size_t i;
+
+  if (addr == NULL || pg_ofs (addr) != 0)
+    return MAP_FAILED;
+  length = file_length (file);
+  if (length <= 0)
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->addr = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+
+  /* The whole region must be free user memory below the stack. */
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      uint8_t *upage = (uint8_t *) addr + i * PGSIZE;
+      if (upage < (uint8_t *) addr
+          || upage >= (uint8_t *) PHYS_BASE - STACK_MAX
+          || page_lookup (upage) != NULL)
+        {
+          free (m);
+          return MAP_FAILED;
+        }
+    }
+
+  /* Use a separate file so the mapping survives close(). */
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      struct page *p = page_alloc ((uint8_t *) addr + ofs, true);
+      if (p == NULL)
+        {
+          /* Undo the pages added so far. */
+          m->page_cnt = i;
+          unmap (m);
+          return MAP_FAILED;
+        }
+      p->type = PAGE_MMAP;
+      p->file = m->file;
+      p->file_ofs = ofs;
+      p->read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+    }
+
+  m->mapid = t->next_mapid++;
+  list_push_back (&t->mmap_list, &m->elem);
+  return m->mapid;
+}
+
+/* Unmaps mapping MAPID of the current process, writing dirty
+   pages back to the file.  Does nothing if there is no such
+   mapping. */
+void
+mmap_unmap (mapid_t mapid)
+{
+  struct mapping *m = lookup_mapping (mapid);
+
+  if (m != NULL)
+    {
+      list_remove (&m->elem);
+      unmap (m);
+    }
+}
+
+/* Closes the files of every mapping of exited process T and frees
+   the mappings.  Their pages must already have been released by
+   page_table_destroy(). */
+void
+mmap_release (struct thread *t)
+{
+  while (!list_empty (&t->mmap_list))
+    {
+      struct mapping *m = list_entry (list_pop_front (&t->mmap_list),
+                                      struct mapping, elem);
+      file_close (m->file);
+      free (m);
+    }
+}
+
+/* Returns the current process's mapping MAPID, or a null
+   pointer. */
+static struct mapping *
+lookup_mapping (mapid_t mapid)
+{
+  struct list *mmap_list = &thread_current ()->mmap_list;
+  struct list_elem *e;
+
+  for (e = list_begin (mmap_list); e != list_end (mmap_list);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->mapid == mapid)
+        return m;
+    }
+  return NULL;
+}
+
+/* Frees M's pages, closes its file, and frees M.  M must not
+   be in any list. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      struct page *p = page_lookup ((uint8_t *) m->addr + i * PGSIZE);
+      if (p != NULL)
+        page_free (p);
+    }
+  file_close (m->file);
+  free (m);
+}
@@ -0,0 +1,28 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <list.h>
+#include <stddef.h>
+
+struct file;
+struct thread;
+
+/* Map region identifier. */
+typedef int mapid_t;
+#define MAP_FAILED ((mapid_t) -1)
+
+/* A memory-mapped file. */
+struct mapping
+{
+  mapid_t mapid;                /* Mapping identifier. */
+  struct file *file;            /* File mapped, reopened for the mapping. */
+  void *addr;                   /* Start of mapped region. */
+  size_t page_cnt;              /* Number of pages mapped. */
+  struct list_elem elem;        /* Element in thread's mmap_list. */
+};
+
+mapid_t mmap_map (struct file *, void *addr);
+void mmap_unmap (mapid_t);
+void mmap_release (struct thread *);
+
+#endif /* vm/mmap.h */
@@ -0,0 +1,624 @@
+/*
+* Description: Supplemental page table.  Records, for every page
+* of a process's user virtual memory, where its contents live so
+* that pages can be loaded lazily on a page fault and written out
+* again when their frame is evicted.
+*/
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "vm/frame.h"
+#include "vm/wset.h"
+#include "filesys/file.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static void page_release (struct page *);
+static void page_destructor (struct hash_elem *, void *aux);
+static bool page_load (struct page *, bool may_evict);
+static void page_fault_around (struct page *);
+static bool page_break_cow (struct page *);
+static bool page_map_zero (struct page *);
+static bool page_is_cached (const struct page *);
+static bool is_stack_access (const void *uaddr, const void *esp);
+
+/* Slab cache of struct page. */
+static struct kmem_cache page_slab;
+
+/* Initializes the page module. */
+void
+page_init (void)
+{
+  kmem_cache_init (&page_slab, "page", sizeof (struct page), NULL);
+}
+
+/* Initializes the current thread's supplemental page table.
+   Returns false if memory allocation fails. */
+bool
+page_table_init (void)
+{
+  return hash_init (&thread_current ()->pages, page_hash, page_less, NULL);
+}
+
+/* Copies PARENT's supplemental page table into the current
+   thread for fork().  Resident pages are shared copy-on-write:
+   both processes map the frame read-only and the first write
+   gives the writer a private copy.  Swapped pages share their
+   swap slot.  Executable pages are read from EXECUTABLE, the
+   child's own handle on the parent's executable.  Memory
+   mappings are not inherited.  PARENT must be blocked.  Returns
+   false if memory allocation fails. */
+bool
+page_table_copy (struct thread *parent, struct file *executable)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  struct hash_iterator i;
+
+  hash_first (&i, &parent->pages);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct page *c;
+
+      if (p->type == PAGE_MMAP)
+        continue;
+
+      c = page_alloc (p->upage, p->writable);
+      if (c == NULL)
+        return false;
+      c->type = p->type;
+      c->file = p->file != NULL ? executable : NULL;
+      c->file_ofs = p->file_ofs;
+      c->read_bytes = p->read_bytes;
+
+      if (frame_pin_page (p))
+        {
+          struct frame *f = p->frame;
+
+          /* A page modified since it was loaded no longer matches
+             its file, so from now on both copies live in swap. */
+          if (p->type != PAGE_SWAP
+              && pagedir_is_dirty (parent->pagedir, p->upage))
+            p->type = c->type = PAGE_SWAP;
+
+          if (p->writable)
+            pagedir_set_writable (parent->pagedir, p->upage, false);
+          if (!pagedir_set_page (pd, c->upage, f->kpage, false))
+            {
+              frame_unpin (f);
+              return false;
+            }
+          frame_add_page (f, c);
+          frame_unpin (f);
+        }
+      else if (p->swap_slot != SWAP_NONE)
+        {
+          swap_dup (p->swap_slot);
+          c->swap_slot = p->swap_slot;
+        }
+    }
+  return true;
+}
+
+/* Frees every page in exited process T's supplemental page table,
+   leaving dirty memory-mapped pages to be written back to their
+   files.  T's page table must have been initialized: a process
+   keeps its page directory only once it has one.  T's page
+   directory must still be intact. */
+void
+page_table_destroy (struct thread *t)
+{
+  hash_destroy (&t->pages, page_destructor);
+}
+
+/* Adds a page at user virtual address UPAGE to the current
+   thread's page table.  The new page is PAGE_ZERO; callers that
+   want another backing store fill in the relevant members.
+   Returns a null pointer if UPAGE is already in use or memory
+   allocation fails. */
+struct page *
+page_alloc (void *upage, bool writable)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  p = kmem_cache_alloc (&page_slab);
+  if (p == NULL)
+    return NULL;
+
+  p->upage = upage;
+  p->owner = t;
+  p->type = PAGE_ZERO;
+  p->writable = writable;
+  p->frame = NULL;
+  p->file = NULL;
+  p->file_ofs = 0;
+  p->read_bytes = 0;
+  p->swap_slot = SWAP_NONE;
+
+  if (hash_insert (&t->pages, &p->hash_elem) != NULL)
+    {
+      /* Already mapped. */
+      kmem_cache_free (&page_slab, p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Returns the current thread's page containing UADDR, or a null
+   pointer if there is none. */
+struct page *
+page_lookup (const void *uaddr)
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = pg_round_down (uaddr);
+  e = hash_find (&thread_current ()->pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Removes P from the current thread's page table and frees
+   it. */
+void
+page_free (struct page *p)
+{
+  hash_delete (&thread_current ()->pages, &p->hash_elem);
+  page_release (p);
+}
+
+/* Brings P into a frame and maps it.  Returns true if
+   successful. */
+bool
+page_in (struct page *p)
+{
+  if (!page_load (p, true))
+    return false;
+  frame_unpin (p->frame);
+  return true;
+}
+
+/* Handles a page fault at FAULT_ADDR in the current process,
+   where ESP is the user stack pointer at the time.  Grows the
+   stack if the access looks like a push, and gives the process
+   a private copy of a copy-on-write page it writes to.  Returns
+   true if the access may now proceed, false if it was
+   invalid. */
+bool
+page_fault_in (const void *fault_addr, const void *esp, bool write)
+{
+  struct page *p;
+
+  wset_fault ();
+
+  p = page_lookup (fault_addr);
+
+  if (p == NULL)
+    {
+      if (!is_stack_access (fault_addr, esp))
+        return false;
+      p = page_alloc (pg_round_down (fault_addr), true);
+      if (p == NULL)
+        return false;
+    }
+
+  if (write && !p->writable)
+    return false;
+
+  if (frame_pin_page (p))
+    {
+      bool success = !write || page_break_cow (p);
+      frame_unpin (p->frame);
+      return success;
+    }
+
+  /* Don't spend a frame on a zero-fill page until it is written. */
+  if (!write && p->type == PAGE_ZERO)
+    return page_map_zero (p);
+  if (!page_in (p))
+    return false;
+  if (p->type == PAGE_FILE || p->type == PAGE_MMAP)
+    page_fault_around (p);
+  return true;
+}
+
+/* Starts evicting frame F by unmapping its pages, so that no
+   owner can modify it while it is written out.  Pages of the page
+   cache are detached right away, left for the frame table to
+   write back to their file.  Pages of exited processes awaiting
+   the reaper are dropped rather than written.  Any other pages
+   stay on F until page_evict_finish().  All pages sharing a frame
+   hold the same data, so it is written once.  Returns true if F
+   must be written to swap.  Called by the frame table with its
+   lock held. */
+bool
+page_evict (struct frame *f)
+{
+  struct list_elem *e;
+  struct page *p;
+  bool dirty = false;
+  bool cache = frame_is_cache (f);
+
+  /* Unmap first so no owner can modify the page while it is
+     being written. */
+  for (e = list_begin (&f->pages); e != list_end (&f->pages); )
+    {
+      p = list_entry (e, struct page, frame_elem);
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+      if (!cache && p->owner->exited)
+        {
+          /* Nobody will read it again; the reaper frees P. */
+          e = list_remove (e);
+          p->frame = NULL;
+          continue;
+        }
+      dirty |= pagedir_is_dirty (p->owner->pagedir, p->upage);
+      e = list_next (e);
+    }
+  if (list_empty (&f->pages))
+    return false;
+
+  if (cache)
+    {
+      /* The pages fault the data back in through the cache. */
+      if (dirty)
+        frame_set_dirty (f);
+      while (!list_empty (&f->pages))
+        list_entry (list_pop_front (&f->pages), struct page,
+                    frame_elem)->frame = NULL;
+      return false;
+    }
+
+  /* Clean pages can be read back from where they came from. */
+  p = list_entry (list_front (&f->pages), struct page, frame_elem);
+  ASSERT (p->type != PAGE_MMAP);
+  return dirty || p->type == PAGE_SWAP;
+}
+
+/* Finishes evicting frame F by detaching the pages page_evict()
+   left on it, leaving F empty.  If SLOT is not SWAP_NONE, F's
+   data was written to SLOT and the pages now live there.  Called
+   by the frame table with its lock held. */
+void
+page_evict_finish (struct frame *f, swap_slot_t slot)
+{
+  struct page *p;
+
+  while (!list_empty (&f->pages))
+    {
+      p = list_entry (list_pop_front (&f->pages), struct page, frame_elem);
+      if (slot != SWAP_NONE)
+        {
+          /* swap_out() gave us one reference, one more for each
+             further sharer. */
+          if (!list_empty (&f->pages))
+            swap_dup (slot);
+          p->type = PAGE_SWAP;
+          p->swap_slot = slot;
+        }
+      p->frame = NULL;
+    }
+}
+
+/* Returns true if any page in frame F has been accessed since
+   the last call, and clears their accessed bits. */
+bool
+page_frame_accessed (struct frame *f)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = p->owner->pagedir;
+
+      if (pagedir_is_accessed (pd, p->upage))
+        {
+          accessed = true;
+          pagedir_set_accessed (pd, p->upage, false);
+        }
+    }
+  return accessed;
+}
+
+/* Returns true if any page in frame F has been written since
+   the last call, and clears their dirty bits. */
+bool
+page_frame_dirty (struct frame *f)
+{
+  struct list_elem *e;
+  bool dirty = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = p->owner->pagedir;
+
+      if (pagedir_is_dirty (pd, p->upage))
+        {
+          dirty = true;
+          pagedir_set_dirty (pd, p->upage, false);
+        }
+    }
+  return dirty;
+}
+
+/* Adds each page in frame F that was accessed since the last
+   sample to its owner's working set sample, and clears its
+   accessed bit.  The access is kept in F's own accessed flag, so
+   that the clock algorithm still sees it.  Called by the frame
+   table with its lock held. */
+void
+page_frame_sample (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = p->owner->pagedir;
+
+      if (pagedir_is_accessed (pd, p->upage))
+        {
+          p->owner->wset_accum++;
+          pagedir_set_accessed (pd, p->upage, false);
+          f->accessed = true;
+        }
+    }
+}
+
+/* Reads ahead of a fault on file-backed page P, which has just
+   been loaded.  The window grows while faults move forward
+   through the file and shrinks when they jump around, so random
+   access does not pull in pages that are never used.  Pages are
+   only read into free frames, never by evicting others. */
+static void
+page_fault_around (struct page *p)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage = p->upage;
+  uint8_t *last = t->last_fault;
+  int i;
+
+  /* After reading ahead N pages, a sequential scan next faults
+     N + 1 pages further on. */
+  if (last != NULL && upage > last
+      && upage <= last + (t->fault_window + 1) * PGSIZE)
+    {
+      t->fault_window = t->fault_window * 2 + 1;
+      if (t->fault_window > FAULT_AROUND_MAX)
+        t->fault_window = FAULT_AROUND_MAX;
+    }
+  else
+    t->fault_window /= 2;
+  t->last_fault = upage;
+
+  for (i = 1; i <= t->fault_window; i++)
+    {
+      struct page *next = page_lookup (upage + i * PGSIZE);
+
+      /* Stop at the end of the segment or mapping. */
+      if (next == NULL || next->type != p->type || next->file != p->file
+          || next->file_ofs != p->file_ofs + i * PGSIZE)
+        break;
+      if (next->frame != NULL)
+        continue;
+      if (!page_load (next, false))
+        break;
+      frame_unpin (next->frame);
+    }
+}
+
+/* Allocates a frame for P and fills it from P's backing store,
+   then maps it into the owner's page directory.  The frame is
+   left pinned.  If MAY_EVICT is false, fails rather than evict
+   another page to make room.  Returns true if successful. */
+static bool
+page_load (struct page *p, bool may_evict)
+{
+  struct frame *f;
+  bool zero;
+
+  ASSERT (p->frame == NULL);
+
+  /* Map the page cache's own frame.  Executable pages are mapped
+     read-only even when writable, so that the first write gives
+     the process a private copy instead of modifying the file. */
+  if (page_is_cached (p))
+    {
+      struct inode *inode = file_get_inode (p->file);
+
+      f = may_evict ? frame_cache_get (inode, p->file_ofs, true)
+                    : frame_cache_try_get (inode, p->file_ofs);
+      if (f == NULL)
+        return false;
+      if (!pagedir_set_page (p->owner->pagedir, p->upage, f->kpage,
+                             p->type == PAGE_MMAP))
+        {
+          frame_unpin (f);
+          return false;
+        }
+      frame_add_page (f, p);
+      return true;
+    }
+
+  /* A page with nothing to read in starts out zeroed. */
+  zero = p->swap_slot == SWAP_NONE
+         && p->type != PAGE_FILE && p->type != PAGE_MMAP;
+  f = may_evict ? frame_alloc (zero) : frame_try_alloc (zero);
+  if (f == NULL)
+    return false;
+
+  if (p->swap_slot != SWAP_NONE)
+    {
+      swap_in (p->swap_slot, f->kpage);
+      p->swap_slot = SWAP_NONE;
+    }
+  else if (p->type == PAGE_FILE || p->type == PAGE_MMAP)
+    {
+      if (file_read_at (p->file, f->kpage, p->read_bytes, p->file_ofs)
+          != (off_t) p->read_bytes)
+        {
+          frame_free (f);
+          return false;
+        }
+      memset ((uint8_t *) f->kpage + p->read_bytes, 0,
+              PGSIZE - p->read_bytes);
+    }
+
+  if (!pagedir_set_page (p->owner->pagedir, p->upage, f->kpage, p->writable))
+    {
+      frame_free (f);
+      return false;
+    }
+  frame_add_page (f, p);
+  return true;
+}
+
+/* Makes resident, writable page P, whose frame the caller has
+   pinned, safe to write.  A memory-mapped page writes straight
+   into the page cache.  Otherwise, if the frame is shared with
+   another process, is in the page cache, or is the frame of
+   zeros, P gets a private copy; if not, the existing frame is
+   simply made writable.  P's frame, old or new, is left pinned.
+   Returns false if no frame is available for the copy. */
+static bool
+page_break_cow (struct page *p)
+{
+  uint32_t *pd = p->owner->pagedir;
+  struct frame *old = p->frame;
+  struct frame *new;
+
+  ASSERT (p->writable);
+
+  if (p->type == PAGE_MMAP)
+    return true;
+  if (!frame_is_zero (old) && !frame_is_cache (old)
+      && frame_share_cnt (old) == 1)
+    {
+      pagedir_set_writable (pd, p->upage, true);
+      return true;
+    }
+
+  new = frame_alloc (frame_is_zero (old));
+  if (new == NULL)
+    return false;
+  if (!frame_is_zero (old))
+    memcpy (new->kpage, old->kpage, PGSIZE);
+
+  /* P stays on its old frame, which the caller has pinned, until
+     the new mapping is in place. */
+  pagedir_clear_page (pd, p->upage);
+  if (!pagedir_set_page (pd, p->upage, new->kpage, true))
+    {
+      pagedir_set_page (pd, p->upage, old->kpage, false);
+      frame_free (new);
+      return false;
+    }
+  frame_remove_page (p);
+  frame_add_page (new, p);
+
+  /* The copy is about to diverge from its origin. */
+  p->type = PAGE_SWAP;
+  return true;
+}
+
+/* Maps the shared frame of zeros read-only at P, which must be
+   a zero-fill page that is not resident.  The first write to P
+   faults and gives it a private frame.  Returns true if
+   successful. */
+static bool
+page_map_zero (struct page *p)
+{
+  struct frame *f = frame_zero ();
+
+  ASSERT (p->type == PAGE_ZERO);
+
+  if (!pagedir_set_page (p->owner->pagedir, p->upage, f->kpage, false))
+    {
+      frame_unpin (f);
+      return false;
+    }
+  frame_add_page (f, p);
+  frame_unpin (f);
+  return true;
+}
+
+/* Releases P's frame or swap slot and frees P.  A dirty
+   memory-mapped page leaves its page cache frame marked dirty,
+   to be written back to the file. */
+static void
+page_release (struct page *p)
+{
+  if (frame_pin_page (p))
+    {
+      uint32_t *pd = p->owner->pagedir;
+
+      if (p->type == PAGE_MMAP && pagedir_is_dirty (pd, p->upage))
+        frame_set_dirty (p->frame);
+      pagedir_clear_page (pd, p->upage);
+      frame_remove_page (p);
+    }
+  else if (p->swap_slot != SWAP_NONE)
+    swap_free (p->swap_slot);
+  kmem_cache_free (&page_slab, p);
+}
+
+/* Returns true if P is loaded by mapping a page cache frame:
+   every memory-mapped page, and executable pages that are all
+   file data.  The last page of a segment usually gets a private
+   copy instead, because its tail must read as zeros while the
+   file goes on. */
+static bool
+page_is_cached (const struct page *p)
+{
+  return p->type == PAGE_MMAP
+         || (p->type == PAGE_FILE && p->read_bytes == PGSIZE);
+}
+
+/* Hash destructor for page_table_destroy(). */
+static void
+page_destructor (struct hash_elem *e, void *aux UNUSED)
+{
+  page_release (hash_entry (e, struct page, hash_elem));
+}
+
+/* Returns true if UADDR, accessed with user stack pointer ESP,
+   should be treated as stack growth.  PUSHA writes 32 bytes
+   below ESP before moving it. */
+static bool
+is_stack_access (const void *uaddr, const void *esp)
+{
+  return (uint8_t *) uaddr >= (uint8_t *) PHYS_BASE - STACK_MAX
+         && is_user_vaddr (uaddr)
+         && (uint8_t *) uaddr >= (uint8_t *) esp - 32;
+}
+
+/* Returns a hash value for page P. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+
+  return a->upage < b->upage;
+}
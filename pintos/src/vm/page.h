@@ -0,0 +1,70 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "vm/swap.h"
+
+/* Maximum size of a process's stack, in bytes. */
+#define STACK_MAX (8 * 1024 * 1024)
+
+/* Most pages read ahead of a fault on a file-backed page. */
+#define FAULT_AROUND_MAX 16
+
+/* Where a page's contents come from when it is not resident. */
+enum page_type
+{
+  PAGE_ZERO,          /* All zeros until first written. */
+  PAGE_FILE,          /* Executable segment read from FILE. */
+  PAGE_MMAP,          /* Memory-mapped file, written back to FILE. */
+  PAGE_SWAP           /* Anonymous data, kept in swap when evicted. */
+};
+
+/* An entry in a process's supplemental page table.  Describes
+   one page of user virtual memory whether or not it is
+   currently in a frame. */
+struct page
+{
+  void *upage;                  /* User virtual address. */
+  struct thread *owner;         /* Owning thread. */
+  enum page_type type;          /* Backing store. */
+  bool writable;                /* False for read-only pages. */
+  struct frame *frame;          /* Frame holding the page, or NULL. */
+  struct list_elem frame_elem;  /* Element in frame's page list. */
+
+  /* PAGE_FILE and PAGE_MMAP. */
+  struct file *file;            /* File to read from. */
+  off_t file_ofs;               /* Offset of page data in FILE. */
+  size_t read_bytes;            /* Bytes to read, rest is zeroed. */
+
+  /* PAGE_SWAP. */
+  swap_slot_t swap_slot;        /* Swap slot, or SWAP_NONE if resident. */
+
+  struct hash_elem hash_elem;   /* Element in thread's page table. */
+};
+
+struct thread;
+struct file;
+struct frame;
+
+void page_init (void);
+bool page_table_init (void);
+bool page_table_copy (struct thread *parent, struct file *executable);
+void page_table_destroy (struct thread *);
+
+struct page *page_alloc (void *upage, bool writable);
+struct page *page_lookup (const void *uaddr);
+void page_free (struct page *);
+
+bool page_in (struct page *);
+bool page_fault_in (const void *fault_addr, const void *esp, bool write);
+bool page_evict (struct frame *);
+void page_evict_finish (struct frame *, swap_slot_t);
+bool page_frame_accessed (struct frame *);
+bool page_frame_dirty (struct frame *);
+void page_frame_sample (struct frame *);
+
+#endif /* vm/page.h */
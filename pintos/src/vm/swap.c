@@ -0,0 +1,243 @@
+/*
+* Description: Swap space.  Evicted anonymous pages are
+* compressed into a cache in kernel memory and only written to
+* page-sized slots on the BLOCK_SWAP device when the cache is
+* full, oldest first.
+*/
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "vm/compress.h"
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors in one swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Most bytes of compressed pages kept in memory. */
+#define CACHE_MAX (256 * 1024)
+
+/* Pages that don't compress to this size go straight to disk. */
+#define COMPRESS_MAX (PGSIZE * 3 / 4)
+
+/* Slots available without a swap device, when the cache is all
+   there is. */
+#define CACHE_ONLY_SLOTS (CACHE_MAX / 128)
+
+/* A swap slot.  A slot in the cache holds compressed data in
+   memory; otherwise its contents are on the swap device at the
+   slot's position. */
+struct slot
+{
+  unsigned short refs;          /* Pages referring to the slot. */
+  unsigned short size;          /* Size of DATA. */
+  uint8_t *data;                /* Compressed page, or NULL if on disk. */
+  struct list_elem lru_elem;    /* Element in cache_lru. */
+};
+
+static struct block *swap_device;   /* Swap block device. */
+static struct bitmap *swap_map;     /* Used slots, true if in use. */
+static struct slot *slots;          /* One per slot in swap_map. */
+static struct list cache_lru;       /* Cached slots, oldest first. */
+static size_t cache_bytes;          /* Bytes of compressed data cached. */
+static uint8_t *zbuf;               /* Compression output. */
+static uint8_t *wbuf;               /* Page being written back. */
+
+/* Protects all of the above and the compressor. */
+static struct lock swap_lock;
+
+/* Statistics. */
+static unsigned long long stored_cnt;     /* Pages compressed into cache. */
+static unsigned long long stored_bytes;   /* Their compressed size. */
+static unsigned long long hit_cnt;        /* Pages read back from cache. */
+static unsigned long long miss_cnt;       /* Pages read back from disk. */
+
+static bool make_room (size_t size);
+static void write_back (swap_slot_t);
+static void uncache (struct slot *);
+
+/* Finds the swap device and sets up the slot table and cache.
+   If there is no swap device, swap_out() panics once the cache
+   is full. */
+void
+swap_init (void)
+{
+  size_t slot_cnt = CACHE_ONLY_SLOTS;
+
+  lock_init (&swap_lock);
+  list_init (&cache_lru);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device != NULL)
+    slot_cnt = block_size (swap_device) / SECTORS_PER_SLOT;
+
+  swap_map = bitmap_create (slot_cnt);
+  slots = calloc (slot_cnt + 1, sizeof *slots);
+  zbuf = palloc_get_page (0);
+  wbuf = palloc_get_page (0);
+  if (swap_map == NULL || slots == NULL || zbuf == NULL || wbuf == NULL)
+    PANIC ("swap table creation failed");
+}
+
+/* Stores the page at KPAGE in a free swap slot and returns the
+   slot, which has a single reference.  Panics if swap is
+   full. */
+swap_slot_t
+swap_out (const void *kpage)
+{
+  swap_slot_t slot;
+  struct slot *s;
+  size_t size;
+  size_t i;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_map, 0, 1, false);
+  if (slot == BITMAP_ERROR)
+    PANIC ("out of swap space");
+  s = &slots[slot];
+  s->refs = 1;
+  s->data = NULL;
+
+  size = compress (kpage, PGSIZE, zbuf, COMPRESS_MAX);
+  if (size != 0 && make_room (size) && (s->data = malloc (size)) != NULL)
+    {
+      memcpy (s->data, zbuf, size);
+      s->size = size;
+      cache_bytes += size;
+      list_push_back (&cache_lru, &s->lru_elem);
+      stored_cnt++;
+      stored_bytes += size;
+    }
+  else if (swap_device != NULL)
+    for (i = 0; i < SECTORS_PER_SLOT; i++)
+      block_write (swap_device, slot * SECTORS_PER_SLOT + i,
+                   (const uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+  else
+    PANIC ("out of swap space");
+  lock_release (&swap_lock);
+  return slot;
+}
+
+/* Reads swap slot SLOT into the page at KPAGE and drops one
+   reference to the slot. */
+void
+swap_in (swap_slot_t slot, void *kpage)
+{
+  struct slot *s = &slots[slot];
+  bool cached;
+  size_t i;
+
+  ASSERT (slot != SWAP_NONE);
+
+  lock_acquire (&swap_lock);
+  cached = s->data != NULL;
+  if (cached)
+    {
+      decompress (s->data, s->size, kpage, PGSIZE);
+      hit_cnt++;
+    }
+  else
+    miss_cnt++;
+  lock_release (&swap_lock);
+
+  /* A slot on disk stays there while we hold a reference, so it
+     can be read without the lock. */
+  if (!cached)
+    for (i = 0; i < SECTORS_PER_SLOT; i++)
+      block_read (swap_device, slot * SECTORS_PER_SLOT + i,
+                  (uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+  swap_free (slot);
+}
+
+/* Adds a reference to swap slot SLOT, for a page that forked
+   processes share while it is swapped out. */
+void
+swap_dup (swap_slot_t slot)
+{
+  ASSERT (slot != SWAP_NONE);
+
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_map, slot));
+  slots[slot].refs++;
+  lock_release (&swap_lock);
+}
+
+/* Drops one reference to swap slot SLOT without reading it.
+   The slot is released when the last reference goes. */
+void
+swap_free (swap_slot_t slot)
+{
+  struct slot *s = &slots[slot];
+
+  ASSERT (slot != SWAP_NONE);
+
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_map, slot));
+  if (--s->refs == 0)
+    {
+      if (s->data != NULL)
+        uncache (s);
+      bitmap_reset (swap_map, slot);
+    }
+  lock_release (&swap_lock);
+}
+
+/* Prints swap cache statistics. */
+void
+swap_print_stats (void)
+{
+  printf ("Swap cache: %llu pages stored at %llu%% size, "
+          "%llu hits, %llu misses\n",
+          stored_cnt,
+          stored_cnt ? stored_bytes * 100 / (stored_cnt * PGSIZE) : 0,
+          hit_cnt, miss_cnt);
+}
+
+/* Writes the oldest cached slots to disk until SIZE more bytes
+   fit in the cache.  Returns false if they can't be made to fit.
+   SWAP_LOCK must be held. */
+static bool
+make_room (size_t size)
+{
+  while (cache_bytes + size > CACHE_MAX)
+    {
+      struct slot *s;
+
+      if (swap_device == NULL || list_empty (&cache_lru))
+        return false;
+      s = list_entry (list_front (&cache_lru), struct slot, lru_elem);
+      write_back (s - slots);
+    }
+  return true;
+}
+
+/* Moves cached slot SLOT to its place on the swap device.
+   SWAP_LOCK must be held. */
+static void
+write_back (swap_slot_t slot)
+{
+  struct slot *s = &slots[slot];
+  size_t i;
+
+  decompress (s->data, s->size, wbuf, PGSIZE);
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_write (swap_device, slot * SECTORS_PER_SLOT + i,
+                 wbuf + i * BLOCK_SECTOR_SIZE);
+  uncache (s);
+}
+
+/* Frees cached slot S's compressed data.  SWAP_LOCK must be
+   held. */
+static void
+uncache (struct slot *s)
+{
+  list_remove (&s->lru_elem);
+  cache_bytes -= s->size;
+  free (s->data);
+  s->data = NULL;
+}
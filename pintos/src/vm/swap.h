@@ -0,0 +1,17 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+
+/* Index of a page-sized slot on the swap device. */
+typedef size_t swap_slot_t;
+#define SWAP_NONE ((swap_slot_t) -1)    /* Page is not in swap. */
+
+void swap_init (void);
+swap_slot_t swap_out (const void *kpage);
+void swap_in (swap_slot_t, void *kpage);
+void swap_dup (swap_slot_t);
+void swap_free (swap_slot_t);
+void swap_print_stats (void);
+
+#endif /* vm/swap.h */
@@ -0,0 +1,121 @@
+/*
+* Description: Working sets and frame quotas.  A sampler thread
+* periodically measures each process's working set from the
+* accessed bits of its resident pages and its page fault rate,
+* and adjusts the number of frames it may hold: a process that
+* faults often gets more, one that rarely faults gives some
+* back.  When the working sets together no longer fit in memory,
+* the process with the largest one is slowed down so that the
+* others can make progress instead of all of them thrashing.
+*/
+#include "vm/wset.h"
+#include <debug.h>
+#include "vm/frame.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Ticks between samples. */
+#define WSET_INTERVAL (TIMER_FREQ / 4)
+
+/* Faults per interval above which a process's quota grows, and
+   below which it shrinks. */
+#define PFF_HIGH 32
+#define PFF_LOW 4
+
+/* Frames a quota grows or shrinks by per interval, and the least
+   it can shrink to. */
+#define QUOTA_STEP 8
+#define QUOTA_MIN 16
+
+/* Ticks a throttled process waits on each page fault. */
+#define THROTTLE_TICKS 2
+
+/* Totals gathered by update_process(). */
+struct wset_totals
+{
+  size_t frame_cnt;             /* Frames in the frame table. */
+  size_t demand;                /* Sum of working set sizes. */
+  struct thread *largest;       /* Process with largest working set. */
+};
+
+static thread_func sampler NO_RETURN;
+static thread_action_func update_process;
+
+/* Starts the working set sampler. */
+void
+wset_init (void)
+{
+  thread_create ("wset", PRI_DEFAULT, sampler, NULL);
+}
+
+/* Records a page fault by the current process.  If the process
+   is being throttled, makes it wait first, unless it holds a
+   lock that others may need. */
+void
+wset_fault (void)
+{
+  struct thread *cur = thread_current ();
+
+  cur->fault_cnt++;
+  if (cur->vm_throttled && heap_empty (&cur->held_locks))
+    timer_sleep (THROTTLE_TICKS);
+}
+
+/* Sampler thread.  Every WSET_INTERVAL ticks, samples working
+   sets, updates frame quotas, and picks the process to throttle
+   if memory is overcommitted. */
+static void
+sampler (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct wset_totals totals;
+      size_t evictions;
+      enum intr_level old_level;
+
+      timer_sleep (WSET_INTERVAL);
+
+      frame_sample (&totals.frame_cnt, &evictions);
+      totals.demand = 0;
+      totals.largest = NULL;
+
+      old_level = intr_disable ();
+      thread_foreach (update_process, &totals);
+
+      /* Only throttle while frames are actually being taken from
+         one process for another. */
+      if (evictions > 0 && totals.demand > totals.frame_cnt
+          && totals.largest != NULL)
+        totals.largest->vm_throttled = true;
+      intr_set_level (old_level);
+    }
+}
+
+/* Updates process T's working set and frame quota from the
+   latest sample, and adds it to the TOTALS_.  Interrupts must be
+   off. */
+static void
+update_process (struct thread *t, void *totals_)
+{
+  struct wset_totals *totals = totals_;
+
+  if (t->pagedir == NULL || t->exited)
+    return;
+
+  t->wset_size = t->wset_accum;
+  t->wset_accum = 0;
+
+  if (t->fault_cnt > PFF_HIGH && t->frame_quota < totals->frame_cnt)
+    t->frame_quota += QUOTA_STEP;
+  else if (t->fault_cnt < PFF_LOW
+           && t->frame_quota >= t->wset_size + QUOTA_STEP
+           && t->frame_quota >= QUOTA_MIN + QUOTA_STEP)
+    t->frame_quota -= QUOTA_STEP;
+  t->fault_cnt = 0;
+
+  t->vm_throttled = false;
+  totals->demand += t->wset_size;
+  if (totals->largest == NULL || t->wset_size > totals->largest->wset_size)
+    totals->largest = t;
+}
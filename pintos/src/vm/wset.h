@@ -0,0 +1,11 @@
+#ifndef VM_WSET_H
+#define VM_WSET_H
+
+/* Frames a new process may hold before it replaces its own
+   pages instead of other processes'. */
+#define FRAME_QUOTA_INIT 64
+
+void wset_init (void);
+void wset_fault (void);
+
+#endif /* vm/wset.h */